@@ -0,0 +1,141 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "stage-timers.h"
+
+// Running the tools without a display, e.g. from path-batch. Everything is set through the
+// environment, so the command lines stay the same:
+//   EMBROIDERY_HEADLESS    non-empty: no window, no pause at the end
+//   EMBROIDERY_SEED        seed for the random generators instead of the fixed default
+//   EMBROIDERY_ITERATIONS  stop after this many candidates (generations for path-evolving)
+//   EMBROIDERY_SECONDS     stop after this many seconds
+//   EMBROIDERY_STATS       file to write the stage timings and counters to, as JSON
+// Without them the tools run as before, until their window is closed.
+struct Batch {
+  bool headless;
+  bool seeded;
+  unsigned int seed;
+  uint64_t iterations;
+  uint64_t budget; // μs
+  std::string stats;
+  uint64_t started;
+
+  Batch(): headless(false), seeded(false), seed(0), iterations(0), budget(0), started(now()) {
+    const char *env;
+
+    if((env = getenv("EMBROIDERY_HEADLESS"))) headless = *env;
+    if((env = getenv("EMBROIDERY_SEED")) && *env) {
+      seeded = true;
+      seed = strtoul(env, 0, 10);
+    }
+    if((env = getenv("EMBROIDERY_ITERATIONS"))) iterations = strtoull(env, 0, 10);
+    if((env = getenv("EMBROIDERY_SECONDS"))) budget = strtod(env, 0) * 1e6;
+    if((env = getenv("EMBROIDERY_STATS"))) stats = env;
+
+    stageTimers().enabled = !stats.empty();
+  }
+
+  static uint64_t now() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+
+    return tv.tv_sec * 1000000ull + tv.tv_usec;
+  }
+
+  // whether the iteration or time budget is used up after done iterations
+  bool exhausted(uint64_t done) const {
+    return (iterations && done >= iterations) || (budget && now() >= started + budget);
+  }
+
+  // writes the stats file, if one was asked for; quality is left out for tools without one
+  void writeStats(const std::string &tool, const std::string &input, uint64_t stitches,
+      bool hasQuality = false, int64_t quality = 0) const {
+    if(stats.empty()) return;
+
+    std::ofstream out(stats.c_str());
+    out << "{\"tool\": " << jsonString(tool) << ", \"input\": " << jsonString(input) <<
+      ", \"seconds\": " << (now() - started) / 1e6 << ", \"stitches\": " << stitches;
+    if(hasQuality) out << ", \"quality\": " << quality;
+    out << ", ";
+    stageTimers().writeFields(out);
+    out << "}" << std::endl;
+
+    if(!out) std::cerr << "Could not write " << stats << std::endl;
+  }
+};
+
+inline Batch &batch() {
+  static Batch b;
+  return b;
+}
+
+// The window of a tool, or nothing at all when headless.
+struct Display {
+  SDL_Window *win;
+  SDL_Surface *screen;
+
+  Display(): win(0), screen(0) { }
+
+  static bool init() {
+    if(SDL_Init(batch().headless? 0: SDL_INIT_VIDEO) != 0) {
+      std::cerr << "Could not init SDL: " << SDL_GetError() << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool open(const char *title, int w, int h) {
+    if(batch().headless) return true;
+
+    win = SDL_CreateWindow(title, 0, 0, w, h, 0);
+    if(!win) {
+      std::cerr << "Could not open window" << std::endl;
+      return false;
+    }
+
+    screen = SDL_GetWindowSurface(win);
+    if(!screen) {
+      std::cerr << "Could not get screen surface" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool visible() const { return screen; }
+
+  // s is stretched over the whole window
+  void show(SDL_Surface *s) {
+    if(!screen) return;
+
+    SDL_BlitScaled(s, 0, screen, 0);
+    SDL_UpdateWindowSurface(win);
+  }
+
+  bool closed() {
+    if(!win) return false;
+
+    SDL_Event event;
+    bool quit = false;
+
+    while(SDL_PollEvent(&event)) {
+      switch(event.type) {
+        case SDL_QUIT: quit = true;
+      }
+    }
+
+    return quit;
+  }
+};
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef EDGE_FIELD_H
+#define EDGE_FIELD_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Smoothed edge normals for rating stitch directions (path-guessing3).
+//
+// The gradient of the brightness (r + g + b) is kept per pixel as a float vector, which is
+// the edge normal with the edge strength as its length, so the rating only needs a dot
+// product. Strong edges are smeared into their surroundings by a number of passes, each
+// of which reads the previous one only, so the rows can be split into bands across all
+// cores. Since the field only depends on the image and the parameters, it is cached on
+// disk under a hash of both ($EMBROIDERY_CACHE, default
+// $XDG_CACHE_HOME/embroidery or ~/.cache/embroidery, empty to disable).
+struct EdgeField {
+  struct Normal {
+    float x, y;
+  };
+
+  int w, h;
+  std::vector<Normal> normals;
+
+  EdgeField(): w(0), h(0) { }
+
+  const Normal &at(int x, int y) const { return normals[y * w + x]; }
+
+  // runs rows(y0, y1) on one band of [0, h) per core
+  template<class Rows> static void forRowBands(int h, Rows rows) {
+    const int bands = std::max(1, std::min(h, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+
+    for(int i = 0; i < bands; ++i) threads.push_back(std::thread(rows, h * i / bands, h * (i + 1) / bands));
+    for(std::thread &t: threads) t.join();
+  }
+
+  void compute(SDL_Surface *src, float smear, float mix, int passes) {
+    w = src->w;
+    h = src->h;
+    normals.assign(w * h, Normal{0, 0});
+
+    std::vector<int> value(w * h);
+
+    SDL_LockSurface(src);
+
+    forRowBands(h, [&](int y0, int y1) {
+      for(int y = y0; y < y1; ++y) {
+        const uint32_t *p = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(src->pixels) + src->pitch * y);
+
+        for(int x = 0; x < w; ++x) value[y * w + x] = (p[x] & 0xff) + ((p[x] & 0xff00) >> 8) + ((p[x] & 0xff0000) >> 16);
+      }
+    });
+
+    SDL_UnlockSurface(src);
+
+    forRowBands(h, [&](int y0, int y1) {
+      for(int y = std::max(y0, 1); y < std::min(y1, h - 1); ++y) {
+        const int *above = &value[(y - 1) * w];
+        const int *row = &value[y * w];
+        const int *below = &value[(y + 1) * w];
+
+        for(int x = 1; x < w - 1; ++x) {
+          const int dx = above[x - 1] + row[x - 1] + below[x - 1] - (above[x + 1] + row[x + 1] + below[x + 1]);
+          const int dy = above[x - 1] + above[x] + above[x + 1] - (below[x - 1] + below[x] + below[x + 1]);
+
+          normals[y * w + x] = Normal{dx / 6.0f, dy / 6.0f};
+        }
+      }
+    });
+
+    // pull every pixel towards its strongest neighbour if that is clearly stronger
+    std::vector<Normal> next(normals);
+    const float smear2 = smear * smear;
+
+    for(int i = 0; i < passes; ++i) {
+      forRowBands(h, [&](int y0, int y1) {
+        for(int y = std::max(y0, 1); y < std::min(y1, h - 1); ++y) {
+          for(int x = 1; x < w - 1; ++x) {
+            const Normal &own = normals[y * w + x];
+            const Normal *best = 0;
+            float bestStrength = own.x * own.x + own.y * own.y;
+
+            for(int yy = -1; yy < 2; ++yy) {
+              for(int xx = -1; xx < 2; ++xx) {
+                const Normal &n = normals[(y + yy) * w + x + xx];
+                const float strength = (n.x * n.x + n.y * n.y) * smear2;
+
+                if(strength > bestStrength) {
+                  best = &n;
+                  bestStrength = strength;
+                }
+              }
+            }
+
+            if(!best) {
+              next[y * w + x] = own;
+              continue;
+            }
+
+            // normals pointing the opposite way describe the same edge
+            const float sign = best->x * own.x + best->y * own.y < 0? -1: 1;
+            next[y * w + x] = Normal{sign * best->x * mix + own.x * (1 - mix), sign * best->y * mix + own.y * (1 - mix)};
+          }
+        }
+      });
+
+      normals.swap(next);
+    }
+  }
+
+  // FNV-1a over the parameters and the pixels
+  static uint64_t key(SDL_Surface *src, float smear, float mix, int passes) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](uint32_t v) { hash = (hash ^ v) * 1099511628211ull; };
+
+    uint32_t bits;
+    add(2); // layout of the cache file
+    add(src->w);
+    add(src->h);
+    memcpy(&bits, &smear, 4);
+    add(bits);
+    memcpy(&bits, &mix, 4);
+    add(bits);
+    add(passes);
+
+    SDL_LockSurface(src);
+
+    for(int y = 0; y < src->h; ++y) {
+      const uint32_t *p = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(src->pixels) + src->pitch * y);
+      for(int x = 0; x < src->w; ++x) add(p[x] & 0xffffff);
+    }
+
+    SDL_UnlockSurface(src);
+
+    return hash;
+  }
+
+  // $EMBROIDERY_CACHE, else embroidery/ in $XDG_CACHE_HOME or ~/.cache, created private to
+  // the user; empty if caching is disabled or the directory is not usable
+  static std::string cacheDir() {
+    const char *env = getenv("EMBROIDERY_CACHE");
+    if(env) return env;
+
+    std::string dir;
+    if((env = getenv("XDG_CACHE_HOME")) && *env) {
+      dir = env;
+    } else if((env = getenv("HOME")) && *env) {
+      dir = std::string(env) + "/.cache";
+    } else {
+      return "";
+    }
+
+    // the base directory may not exist yet either
+    mkdir(dir.c_str(), 0700);
+    dir += "/embroidery";
+    if(mkdir(dir.c_str(), 0700) && errno != EEXIST) return "";
+
+    struct stat st;
+    if(lstat(dir.c_str(), &st) || !S_ISDIR(st.st_mode) || st.st_uid != geteuid()) return "";
+
+    return dir;
+  }
+
+  static std::string cacheFile(uint64_t key) {
+    const std::string dir = cacheDir();
+    if(dir.empty()) return "";
+
+    char name[64];
+    snprintf(name, sizeof(name), "/embroidery-edges-%016llx", static_cast<unsigned long long>(key));
+    return dir + name;
+  }
+
+  struct Header {
+    char magic[8];
+    uint64_t key;
+    int32_t w, h;
+  };
+
+  static Header header(uint64_t key, int width, int height) {
+    Header hd;
+    memcpy(hd.magic, "EMBEDGES", sizeof(hd.magic));
+    hd.key = key;
+    hd.w = width;
+    hd.h = height;
+    return hd;
+  }
+
+  static bool readAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+
+    while(size) {
+      const ssize_t n = read(fd, p, size);
+      if(n <= 0) return false;
+      p += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  static bool writeAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+
+    while(size) {
+      const ssize_t n = write(fd, p, size);
+      if(n <= 0) return false;
+      p += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  // only trusts a regular file of our own with exactly the expected header and size
+  bool load(const std::string &file, uint64_t key, int width, int height) {
+    const int fd = open(file.c_str(), O_RDONLY | O_NOFOLLOW);
+    if(fd < 0) return false;
+
+    const Header expected = header(key, width, height);
+    const size_t count = static_cast<size_t>(width) * height;
+    Header hd;
+    struct stat st;
+
+    bool ok = !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_uid == geteuid() &&
+      static_cast<uint64_t>(st.st_size) == sizeof(Header) + count * sizeof(Normal) &&
+      readAll(fd, &hd, sizeof(hd)) && !memcmp(&hd, &expected, sizeof(hd));
+
+    if(ok) {
+      std::vector<Normal> loaded(count);
+      ok = readAll(fd, &loaded[0], count * sizeof(Normal));
+
+      if(ok) {
+        w = width;
+        h = height;
+        normals.swap(loaded);
+      }
+    }
+
+    close(fd);
+    return ok;
+  }
+
+  // written to a fresh temporary file first, so concurrent runs never see half a file
+  void save(const std::string &file, uint64_t key) const {
+    std::string tmp = file + ".XXXXXX";
+    const int fd = mkstemp(&tmp[0]);
+    if(fd < 0) return;
+
+    const Header hd = header(key, w, h);
+    bool ok = writeAll(fd, &hd, sizeof(hd)) && writeAll(fd, &normals[0], normals.size() * sizeof(Normal));
+    ok = !close(fd) && ok;
+
+    if(!ok || rename(tmp.c_str(), file.c_str())) remove(tmp.c_str());
+  }
+
+  void computeCached(SDL_Surface *src, float smear, float mix, int passes) {
+    const uint64_t k = key(src, smear, mix, passes);
+    const std::string file = cacheFile(k);
+
+    if(!file.empty() && load(file, k, src->w, src->h)) return;
+
+    compute(src, smear, mix, passes);
+    if(!file.empty()) save(file, k);
+  }
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef INCREMENTAL_RATING_H
+#define INCREMENTAL_RATING_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "planar-image.h"
+#include "stitch-raster.h"
+
+// Incremental rating for the path-guessing tools.
+//
+// Rendering all paths, downsampling the result and comparing every pixel against the
+// reference costs a full image pass per candidate, even though a mutation only changes one
+// or two stitches. Instead this keeps
+//  - for every full resolution pixel, how many stitches of each layer cover it, a byte per
+//    layer (4 bytes per pixel like the surface it replaces), counts that do not fit in a
+//    side table,
+//  - for every downsampled pixel, the colour sums over its window, the resulting view and
+//    its current error,
+// and only touches the pixels under the stitches that were actually changed. Rejected
+// candidates are rolled back by replaying the changed segments in reverse.
+//
+// Layers are painted in index order, i.e. a pixel shows the colour of the highest layer
+// covering it (or black). Lines are walked like SDL's software renderer draws them, so the
+// rating is the same as rendering everything, downsampling it with the window of the
+// respective tool and comparing the result against the reference.
+struct IncrementalRating {
+  // the pixels of the input image a downsampled pixel (x, y) averages
+  enum Window {
+    BLOCK,    // SCALE x SCALE block at (x * SCALE, y * SCALE) (path-guessing, path-guessing2)
+    CENTERED  // (2 * SCALE + 1)^2 window around (x * SCALE, y * SCALE) (path-guessing3)
+  };
+
+  static const int LAYERS = 4;
+
+  // coverage counts from here on are kept in overflow
+  static const uint8_t SATURATED = 255;
+
+  struct Segment {
+    int layer;
+    int x0, y0, x1, y1;
+  };
+
+  int w, h;
+  int zw, zh;
+  int count;
+  int64_t pixelCost;
+  int64_t error;
+
+  uint32_t colors[LAYERS];
+  std::vector<uint8_t> coverage;
+  std::unordered_map<size_t, int> overflow;
+  PlanarImage reference;
+  PlanarImage view;
+  std::vector<int32_t> sums;
+  std::vector<int32_t> errors;
+  std::vector<uint8_t> rated;
+  std::vector<int> firstX, lastX, firstY, lastY;
+  std::vector<Segment> addedSegments, removedSegments;
+
+  IncrementalRating(const PlanarImage &zoomedReference, int width, int height, int scale, Window window, int64_t cost):
+      w(width), h(height), zw(zoomedReference.w), zh(zoomedReference.h), pixelCost(cost),
+      coverage(w * h * LAYERS), reference(zoomedReference), view(zw, zh), sums(zw * zh * 3), errors(zw * zh), rated(zw * zh) {
+    for(int i = 0; i < LAYERS; ++i) colors[i] = 0;
+
+    count = window == BLOCK? scale * scale: (2 * scale + 1) * (2 * scale + 1);
+
+    windowRange(firstX, lastX, w, zw, scale, window);
+    windowRange(firstY, lastY, h, zh, scale, window);
+
+    for(int y = 0; y < zh; ++y) {
+      for(int x = 0; x < zw; ++x) {
+        const int i = y * zw + x;
+
+        // same border as rate()
+        rated[i] = x >= 1 && x < zw - 1 && y >= 1 && y < zh - 1;
+        errors[i] = pixelError(i);
+      }
+    }
+
+    error = pixelCost * sumSquaredDifferences(reference, view, 1, 1, zw - 1, zh - 1);
+  }
+
+  // for each full resolution coordinate, the range of downsampled coordinates whose window contains it
+  static void windowRange(std::vector<int> &first, std::vector<int> &last, int size, int zoomedSize, int scale, Window window) {
+    first.resize(size);
+    last.resize(size);
+
+    for(int i = 0; i < size; ++i) {
+      if(window == BLOCK) {
+        first[i] = i / scale;
+        last[i] = i / scale < zoomedSize? i / scale: -1;
+      } else {
+        // simulateRGBView<SCALE> leaves the outermost SCALE pixels black
+        first[i] = std::max(scale, (i + scale - 1) / scale - 1);
+        last[i] = std::min(zoomedSize - scale - 1, i / scale + 1);
+      }
+    }
+  }
+
+  void setColor(int layer, unsigned int r, unsigned int g, unsigned int b) {
+    colors[layer] = r + g * 0x100 + b * 0x10000;
+  }
+
+  int64_t quality() const { return -error; }
+
+  int64_t pixelError(int i) const {
+    int64_t delta = 0;
+
+    for(int c = 0; c < 3; ++c) {
+      const int d = reference.planes[c][i] - view.planes[c][i];
+      delta += d * d;
+    }
+
+    return pixelCost * delta;
+  }
+
+  int top(const uint8_t *c) const {
+    for(int l = LAYERS - 1; l >= 0; --l) {
+      if(c[l]) return l;
+    }
+
+    return -1;
+  }
+
+  uint32_t color(int layer) const {
+    return layer < 0? 0: colors[layer];
+  }
+
+  void recolor(int x, int y, uint32_t from, uint32_t to) {
+    const int dr = static_cast<int>(to & 0xff) - static_cast<int>(from & 0xff);
+    const int dg = static_cast<int>((to & 0xff00) >> 8) - static_cast<int>((from & 0xff00) >> 8);
+    const int db = static_cast<int>((to & 0xff0000) >> 16) - static_cast<int>((from & 0xff0000) >> 16);
+
+    for(int zy = firstY[y]; zy <= lastY[y]; ++zy) {
+      for(int zx = firstX[x]; zx <= lastX[x]; ++zx) {
+        const int i = zy * zw + zx;
+
+        sums[i * 3 + 0] += dr;
+        sums[i * 3 + 1] += dg;
+        sums[i * 3 + 2] += db;
+
+        for(int c = 0; c < 3; ++c) view.planes[c][i] = sums[i * 3 + c] / count;
+
+        const int64_t e = pixelError(i);
+        if(rated[i]) error += e - errors[i];
+        errors[i] = e;
+      }
+    }
+  }
+
+  void cover(int layer, int x, int y, int delta) {
+    if(x < 0 || y < 0 || x >= w || y >= h) return;
+
+    const size_t i = (y * w + x) * LAYERS;
+    uint8_t *c = &coverage[i];
+    const int before = top(c);
+
+    const int n = c[layer] == SATURATED? overflow[i + layer] + delta: c[layer] + delta;
+    if(n >= SATURATED) {
+      overflow[i + layer] = n;
+      c[layer] = SATURATED;
+    } else {
+      if(c[layer] == SATURATED) overflow.erase(i + layer);
+      c[layer] = n;
+    }
+
+    const int after = top(c);
+
+    if(before != after) recolor(x, y, color(before), color(after));
+  }
+
+  void line(int layer, int x0, int y0, int x1, int y1, int delta) {
+    walkLine(x0, y0, x1, y1, [&](int x, int y) { cover(layer, x, y, delta); });
+  }
+
+  void addSegment(int layer, int x0, int y0, int x1, int y1) {
+    line(layer, x0, y0, x1, y1, 1);
+    addedSegments.push_back({layer, x0, y0, x1, y1});
+  }
+
+  void removeSegment(int layer, int x0, int y0, int x1, int y1) {
+    line(layer, x0, y0, x1, y1, -1);
+    removedSegments.push_back({layer, x0, y0, x1, y1});
+  }
+
+  // adds layers.layer(i) for every layer i, in its colour
+  template<class Layers> void addLayers(Layers &layers) {
+    for(int i = 0; i < LAYERS; ++i) {
+      const auto &p = layers.layer(i);
+      setColor(i, p.r, p.g, p.b);
+      addPath(i, p);
+    }
+  }
+
+  template<class Path> void addPath(int layer, const Path &p) {
+    int x = w / 2;
+    int y = h / 2;
+
+    for(const auto &s: p.steps) {
+      line(layer, x, y, x + s.x, y + s.y, 1);
+      x += s.x;
+      y += s.y;
+    }
+  }
+
+  // steps [first, first + added) of p replaced the removed steps in old, which the caller
+  // keeps, so candidates can be made in place instead of on a copy of the path
+  template<class Path, class Step> void replaceSteps(int layer, const Path &p, size_t first, const Step *old, size_t removed, size_t added) {
+    const auto start = p.steps.position(first);
+    const int sx = w / 2 + start.x;
+    const int sy = h / 2 + start.y;
+
+    // add before removing, so pixels covered by both never change colour
+    int x = sx;
+    int y = sy;
+
+    for(size_t i = first; i < first + added; ++i) {
+      const auto &s = p.steps[i];
+      addSegment(layer, x, y, x + s.x, y + s.y);
+      x += s.x;
+      y += s.y;
+    }
+
+    x = sx;
+    y = sy;
+
+    for(size_t i = 0; i < removed; ++i) {
+      removeSegment(layer, x, y, x + old[i].x, y + old[i].y);
+      x += old[i].x;
+      y += old[i].y;
+    }
+  }
+
+  void accept() {
+    addedSegments.clear();
+    removedSegments.clear();
+  }
+
+  void reject() {
+    for(size_t i = 0; i < removedSegments.size(); ++i) {
+      const Segment &s = removedSegments[i];
+      line(s.layer, s.x0, s.y0, s.x1, s.y1, 1);
+    }
+
+    for(size_t i = 0; i < addedSegments.size(); ++i) {
+      const Segment &s = addedSegments[i];
+      line(s.layer, s.x0, s.y0, s.x1, s.y1, -1);
+    }
+
+    accept();
+  }
+
+  // the downsampled view of the current state, like simulateRGBView would produce it
+  void toSurface(SDL_Surface *dst) const {
+    view.toSurface(dst);
+  }
+};
+
+#endif
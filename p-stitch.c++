@@ -0,0 +1,94 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "vp3.h"
+
+using namespace std;
+
+// Streaming replacement for p-stitch.ey: reads the .p output of path-guessing/path-filling line
+// by line and writes the stitches straight into the .vp3, so input size is not limited.
+
+bool colorOf(const string &name, unsigned int &r, unsigned int &g, unsigned int &b) {
+  if(name == "White") { r = 255; g = 255; b = 255; return true; }
+  if(name == "Red") { r = 255; g = 0; b = 0; return true; }
+  if(name == "Green") { r = 0; g = 255; b = 0; return true; }
+  if(name == "Blue") { r = 0; g = 0; b = 255; return true; }
+
+  return false;
+}
+
+int main(int argc, char **argv) {
+  if(argc != 4) {
+    cerr << "usage: ./p-stitch <μm per unit (try 300)> <input.p (from path-guessing)> <output.vp3>" << endl;
+    return 1;
+  }
+
+  // the stitches are written in units of 100 μm
+  int scale;
+  istringstream scaleStr(argv[1]);
+  if(!(scaleStr >> scale) || scale < 100) {
+    cerr << "μm per unit has to be at least 100" << endl;
+    return 1;
+  }
+  scale /= 100;
+
+  cout << "Scale μm: " << scale * 100 << endl;
+
+  ifstream p(argv[2]);
+  if(!p) {
+    cerr << "Could not open " << argv[2] << endl;
+    return 1;
+  }
+
+  ofstream vp3(argv[3], ios::binary);
+  if(!vp3) {
+    cerr << "Could not open " << argv[3] << endl;
+    return 1;
+  }
+
+  try {
+    VP3Writer writer(vp3);
+    bool inColor = false;
+    string line;
+
+    while(getline(p, line)) {
+      unsigned int r, g, b;
+
+      if(line.empty()) continue;
+
+      if(colorOf(line, r, g, b)) {
+        if(inColor) writer.endColor();
+        writer.beginColor(line, r, g, b);
+        inColor = true;
+        continue;
+      }
+
+      if(!inColor) {
+        cerr << "Stitch before first colour: " << line << endl;
+        return 1;
+      }
+
+      int dx, dy;
+      istringstream step(line);
+      if(!(step >> dx >> dy)) {
+        cerr << "Could not parse: " << line << endl;
+        return 1;
+      }
+
+      writer.stitch(dx * scale, dy * scale);
+    }
+
+    if(inColor) writer.endColor();
+    writer.finish();
+  } catch(const char *err) {
+    cerr << err << endl;
+    return 1;
+  }
+
+  if(!vp3) {
+    cerr << "Could not write " << argv[3] << endl;
+    return 1;
+  }
+}
@@ -0,0 +1,218 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "stage-timers.h"
+
+using namespace std;
+
+// Runs the path tools without a display over a list of jobs, several at a time, and prints
+// one JSON object per finished job: its exit status (-1 if it could not be started),
+// wall-clock time and the stage timings and counters the tool wrote (see batch.h), or null
+// if it wrote none.
+//
+// Every line of the job list is a tool with its arguments as on its command line, e.g.
+//   path-guessing 3 10 customer-17.png customer-17.vp3 2 20
+// Empty lines and lines starting with # are skipped, tools are looked up next to path-batch.
+// The tools keep their settings in globals, so every job gets a process of its own. Job n
+// runs with seed + n, so with an iteration budget a batch can be repeated exactly (for
+// path-evolving only with a single island, the others exchange individuals as they come).
+
+struct Job {
+  size_t index;
+  string line;
+  vector<string> args;
+  string stats;
+  uint64_t started;
+};
+
+uint64_t time() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  return tv.tv_sec * 1000000ull + tv.tv_usec;
+}
+
+vector<Job> readJobs(istream &in) {
+  vector<Job> jobs;
+  string line;
+
+  while(getline(in, line)) {
+    istringstream words(line);
+    Job job;
+    string word;
+
+    while(words >> word) job.args.push_back(word);
+    if(job.args.empty() || job.args[0][0] == '#') continue;
+
+    job.index = jobs.size();
+    job.line = line;
+    job.started = 0;
+    jobs.push_back(job);
+  }
+
+  return jobs;
+}
+
+string readFile(const string &name) {
+  ifstream in(name.c_str());
+  stringstream content;
+  content << in.rdbuf();
+
+  string s = content.str();
+  while(!s.empty() && (s.back() == '\n' || s.back() == ' ')) s.pop_back();
+  return s;
+}
+
+// one line of the output, stats is the JSON the tool wrote or empty
+void report(const Job &job, int exitCode, const string &stats) {
+  const double seconds = job.started? (time() - job.started) / 1e6: 0;
+
+  cout << "{\"job\": " << job.index << ", \"command\": " << jsonString(job.line) << ", \"exit\": " << exitCode <<
+    ", \"seconds\": " << seconds << ", \"stats\": " << (stats.empty()? "null": stats) << "}" << endl;
+}
+
+// forks the tool of job, 0 if that did not even get that far
+pid_t start(Job &job, const string &dir, unsigned int seed, uint64_t iterations, double seconds) {
+  char stats[] = "/tmp/embroidery-stats-XXXXXX";
+  const int fd = mkstemp(stats);
+  if(fd < 0) {
+    cerr << "Could not create a stats file" << endl;
+    return 0;
+  }
+  close(fd);
+
+  job.stats = stats;
+  job.started = time();
+
+  const pid_t pid = fork();
+  if(pid < 0) {
+    cerr << "Could not start job " << job.index << endl;
+    remove(stats);
+    return 0;
+  }
+
+  if(pid) return pid;
+
+  setenv("EMBROIDERY_HEADLESS", "1", 1);
+  setenv("EMBROIDERY_SEED", to_string(seed + job.index).c_str(), 1);
+  setenv("EMBROIDERY_ITERATIONS", to_string(iterations).c_str(), 1);
+  setenv("EMBROIDERY_SECONDS", to_string(seconds).c_str(), 1);
+  setenv("EMBROIDERY_STATS", stats, 1);
+
+  // the progress lines would interleave with the results
+  const int null = open("/dev/null", O_WRONLY);
+  if(null >= 0) dup2(null, 1);
+
+  const string tool = job.args[0].find('/') == string::npos? dir + job.args[0]: job.args[0];
+  vector<char *> argv;
+  for(string &a: job.args) argv.push_back(&a[0]);
+  argv.push_back(0);
+
+  execv(tool.c_str(), &argv[0]);
+  cerr << "Could not run " << tool << endl;
+  _exit(127);
+}
+
+int main(int argc, const char *const argv[]) {
+  if(argc < 2 || argc > 6) {
+    cerr << "usage: ./path-batch <job list, - for stdin> [parallel jobs (default: one per core)] "
+      "[iterations per job (0: no limit)] [seconds per job (0: no limit, try 60)] [seed (default: 1)]" << endl;
+    return 1;
+  }
+
+  size_t parallel = thread::hardware_concurrency();
+  if(argc > 2) {
+    istringstream parallel_arg(argv[2]);
+    parallel_arg >> parallel;
+  }
+  if(parallel < 1) parallel = 1;
+
+  uint64_t iterations = 0;
+  if(argc > 3) {
+    istringstream iterations_arg(argv[3]);
+    iterations_arg >> iterations;
+  }
+
+  double seconds = 0;
+  if(argc > 4) {
+    istringstream seconds_arg(argv[4]);
+    seconds_arg >> seconds;
+  }
+
+  unsigned int seed = 1;
+  if(argc > 5) {
+    istringstream seed_arg(argv[5]);
+    seed_arg >> seed;
+  }
+
+  if(!iterations && seconds <= 0) cerr << "without an iteration or time limit the optimizers never finish" << endl;
+
+  vector<Job> jobs;
+  if(string(argv[1]) == "-") {
+    jobs = readJobs(cin);
+  } else {
+    ifstream list(argv[1]);
+    if(!list) {
+      cerr << "Could not open " << argv[1] << endl;
+      return 1;
+    }
+    jobs = readJobs(list);
+  }
+
+  const string self = argv[0];
+  const string dir = self.find('/') == string::npos? "./": self.substr(0, self.rfind('/') + 1);
+
+  map<pid_t, size_t> running;
+  size_t next = 0;
+  int failed = 0;
+
+  while(next < jobs.size() || !running.empty()) {
+    while(next < jobs.size() && running.size() < parallel) {
+      Job &job = jobs[next++];
+
+      const pid_t pid = start(job, dir, seed, iterations, seconds);
+      if(pid) {
+        running[pid] = job.index;
+      } else {
+        ++failed;
+        report(job, -1, "");
+      }
+    }
+
+    if(running.empty()) continue;
+
+    int status;
+    const pid_t pid = wait(&status);
+    if(pid < 0) {
+      cerr << "Lost track of the running jobs" << endl;
+      return 1;
+    }
+
+    auto it = running.find(pid);
+    if(it == running.end()) continue;
+
+    const Job &job = jobs[it->second];
+    running.erase(it);
+
+    const int exitCode = WIFEXITED(status)? WEXITSTATUS(status): 128 + WTERMSIG(status);
+    if(exitCode) ++failed;
+
+    const string stats = readFile(job.stats);
+    remove(job.stats.c_str());
+
+    report(job, exitCode, stats);
+  }
+
+  return failed? 1: 0;
+}
@@ -0,0 +1,228 @@
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <stdint.h>
+#include <math.h>
+
+#include "path.h"
+#include "planar-image.h"
+#include "stitch-raster.h"
+#include "incremental-rating.h"
+#include "edge-field.h"
+#include "stage-timers.h"
+
+// Runs the kernels behind the stages of the path tools on a fixed synthetic image and fixed
+// random paths, each on its own for a while, and prints the time per call of every kernel
+// as one JSON object, so throughput can be compared between builds (make bench). Needs no
+// display.
+
+#define WIDTH 960
+#define HEIGHT 720
+#define SCALE 2
+#define PATH_STEPS 20000
+#define MAXSTITCH 20
+#define PIXEL_COST 10
+#define EDGEDETECT_SMEAR 0.7
+#define EDGEDETECT_NEW 0.8
+#define EDGEDETECT_PASSES 10
+#define CROSSOVER_DISTANCE 10
+
+using namespace std;
+
+struct Path {
+  Steps steps;
+  unsigned int r, g, b;
+};
+
+// smooth gradients with a few rings and a hard diagonal edge, the same on every run
+SDL_Surface *syntheticImage() {
+  SDL_Surface *s = SDL_CreateRGBSurface(0, WIDTH, HEIGHT, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+  if(!s) throw "Could not create image";
+
+  SDL_LockSurface(s);
+
+  for(int y = 0; y < HEIGHT; ++y) {
+    uint32_t *row = reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(s->pixels) + s->pitch * y);
+
+    for(int x = 0; x < WIDTH; ++x) {
+      const int dx = x - WIDTH / 2;
+      const int dy = y - HEIGHT / 2;
+      const int ring = static_cast<int>(sqrt(dx * dx + dy * dy)) / 40 % 2;
+
+      const unsigned int r = x * 255 / WIDTH;
+      const unsigned int g = ring? 255 - y * 255 / HEIGHT: y * 255 / HEIGHT;
+      const unsigned int b = x * HEIGHT > y * WIDTH? 200: 40;
+
+      row[x] = r + g * 0x100 + b * 0x10000 + 0xff000000u;
+    }
+  }
+
+  SDL_UnlockSurface(s);
+
+  return s;
+}
+
+// random walk from the centre, bouncing off the borders
+Path randomPath(minstd_rand &rng, unsigned int r, unsigned int g, unsigned int b) {
+  uniform_int_distribution<int> step(-MAXSTITCH, MAXSTITCH);
+  Path p;
+  int x = WIDTH / 2;
+  int y = HEIGHT / 2;
+
+  p.r = r;
+  p.g = g;
+  p.b = b;
+
+  for(int i = 0; i < PATH_STEPS; ++i) {
+    Steps::Step s = {step(rng), step(rng)};
+    if(x + s.x < 0 || x + s.x >= WIDTH) s.x = -s.x;
+    if(y + s.y < 0 || y + s.y >= HEIGHT) s.y = -s.y;
+
+    p.steps.push_back(s);
+    x += s.x;
+    y += s.y;
+  }
+
+  return p;
+}
+
+struct Kernel {
+  Stage stage;
+  const char *name;
+  uint64_t calls;
+  double seconds;
+};
+
+vector<Kernel> kernels;
+
+// calls kernel until seconds have passed, at least once, and records it as stage/name
+template<class F> void run(Stage stage, const char *name, double seconds, F kernel) {
+  typedef chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  const clock::time_point end = start + chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+  clock::time_point now;
+  Kernel k = {stage, name, 0, 0};
+
+  do {
+    kernel();
+    ++k.calls;
+    now = clock::now();
+  } while(now < end);
+
+  k.seconds = chrono::duration<double>(now - start).count();
+  kernels.push_back(k);
+}
+
+int main(int argc, const char *const argv[]) {
+  if(argc > 2) {
+    cerr << "usage: ./path-bench [seconds per kernel (default: 1)]" << endl;
+    return 1;
+  }
+
+  double seconds = 1;
+  if(argc > 1) {
+    istringstream seconds_arg(argv[1]);
+    seconds_arg >> seconds;
+  }
+
+  SDL_Surface *img = syntheticImage();
+
+  minstd_rand rng(1);
+  vector<Path> paths;
+  paths.push_back(randomPath(rng, 0, 0, 255));
+  paths.push_back(randomPath(rng, 0, 255, 0));
+  paths.push_back(randomPath(rng, 255, 0, 0));
+  paths.push_back(randomPath(rng, 255, 255, 255));
+
+  volatile int64_t sink = 0; // keeps the results of the kernels alive
+
+  StitchRaster raster(WIDTH, HEIGHT, SCALE);
+
+  run(STAGE_RENDER, "raster", seconds, [&]() {
+    raster.clear();
+    for(const Path &p: paths) raster.addPath(p);
+  });
+
+  IntegralImage integral;
+  PlanarImage reference, view;
+  integral.build(img);
+  downsampleBlock(integral, SCALE, reference);
+
+  run(STAGE_DOWNSAMPLE, "integral", seconds, [&]() { integral.build(img); });
+  run(STAGE_DOWNSAMPLE, "block", seconds, [&]() { downsampleBlock(integral, SCALE, view); });
+  run(STAGE_DOWNSAMPLE, "centered", seconds, [&]() { downsampleCentered(integral, SCALE, view); });
+  run(STAGE_DOWNSAMPLE, "raster", seconds, [&]() { raster.downsample(view); });
+
+  run(STAGE_RATE, "full", seconds, [&]() {
+    sink += sumSquaredDifferences(reference, view, 1, 1, view.w - 1, view.h - 1);
+  });
+
+  // one candidate of the path-guessing tools: a vertex is moved in place, the change rated
+  // incrementally and taken back again, so every call rates against the same paths
+  IncrementalRating rating(reference, WIDTH, HEIGHT, SCALE, IncrementalRating::BLOCK, PIXEL_COST);
+  for(int i = 0; i < IncrementalRating::LAYERS; ++i) {
+    rating.setColor(i, paths[i].r, paths[i].g, paths[i].b);
+    rating.addPath(i, paths[i]);
+  }
+
+  uniform_int_distribution<size_t> vertex(0, PATH_STEPS - 2);
+  uniform_int_distribution<int> move(-3, 3);
+  int layer = 0;
+
+  run(STAGE_RATE, "incremental", seconds, [&]() {
+    const size_t i = vertex(rng);
+    const int dx = move(rng);
+    const int dy = move(rng);
+    const Steps::Change c = paths[layer].steps.moveVertex(i, dx, dy);
+
+    rating.replaceSteps(layer, paths[layer], c.first, c.old, c.removed, c.added);
+    sink += rating.quality();
+    rating.reject();
+    paths[layer].steps.undo(c);
+
+    layer = (layer + 1) % IncrementalRating::LAYERS;
+  });
+
+  EdgeField edges;
+
+  run(STAGE_EDGE, "field", seconds, [&]() {
+    edges.compute(img, EDGEDETECT_SMEAR, EDGEDETECT_NEW, EDGEDETECT_PASSES);
+  });
+
+  // cross() indexes one parent and looks up every vertex of the other
+  run(STAGE_CROSSOVER, "grid", seconds, [&]() {
+    VertexGrid grid(paths[0].steps, CROSSOVER_DISTANCE);
+    sink += grid.entries.size();
+  });
+
+  const VertexGrid grid(paths[0].steps, CROSSOVER_DISTANCE);
+  vector<size_t> found;
+
+  run(STAGE_CROSSOVER, "lookups", seconds, [&]() {
+    Steps::Step p = {0, 0};
+
+    for(const Steps::Step &s: paths[1].steps) {
+      p.x += s.x;
+      p.y += s.y;
+      grid.near(p.x, p.y, found);
+      sink += found.size();
+    }
+  });
+
+  SDL_FreeSurface(img);
+
+  // average is seconds per call
+  cout << "{\"tool\": \"path-bench\", \"width\": " << WIDTH << ", \"height\": " << HEIGHT << ", \"scale\": " << SCALE <<
+    ", \"steps\": " << PATH_STEPS << ", \"kernels\": {";
+  for(size_t i = 0; i < kernels.size(); ++i) {
+    const Kernel &k = kernels[i];
+    cout << (i? ", ": "") << "\"" << StageTimers::stageName(k.stage) << "/" << k.name << "\": {\"calls\": " << k.calls <<
+      ", \"seconds\": " << k.seconds << ", \"average\": " << k.seconds / k.calls << "}";
+  }
+  cout << "}}" << endl;
+
+  return 0;
+}
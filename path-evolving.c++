@@ -8,75 +8,79 @@
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include "batch.h"
+#include "path.h"
+#include "planar-image.h"
+#include "pyramid.h"
+#include "stage-timers.h"
+#include "stitch-raster.h"
+#include "vp3.h"
 
 #define STITCH_COST 10
 #define MAXSTITCH 20
 #define POPULATION_SIZE 128
 #define NO_QUALITY -999999999999ll
+#define LEVEL_PATIENCE 10 // seconds without a better individual before the next finer level
 int SCALE = 3;
 int DEFAULT_STITCH = 10;
 
 using namespace std;
 
-struct Path {
-  struct Step {
-    int x, y;
-  };
+// every island has its own generator, rand() would be shared between the threads
+thread_local minstd_rand rng;
 
-  std::vector<Step> steps;
-  unsigned int r, g, b;
+int randomInt() {
+  return rng() & 0x7fffffff;
+}
 
-  void render(SDL_Surface *s, SDL_Renderer *rnd) {
-    SDL_SetRenderDrawColor(rnd, r, g, b, 255);
+struct Path {
+  typedef Steps::Step Step;
 
-    int x = s->w / 2;
-    int y = s->h / 2;
+  Steps steps;
+  unsigned int r, g, b;
 
-    for(Step &s: steps) {
-      SDL_RenderDrawLine(rnd, x, y, x + s.x, y + s.y);
-      x += s.x;
-      y += s.y;
-    }
+  void render(StitchRaster &raster) const {
+    raster.addPath(*this);
   }
 
   void mutate(SDL_Surface *) {
     if(steps.size() < 20) return;
     
-    int i = 1 + (rand() % (steps.size() - 2));
+    int i = 1 + (randomInt() % (steps.size() - 2));
 
-    int dx = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
-    int dy = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
+    int dx = (randomInt() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
+    int dy = (randomInt() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
 
-    steps[i].x += dx;
-    steps[i].y += dy;
-    steps[i + 1].x -= dx;
-    steps[i + 1].y -= dy;
+    steps.offset(i, dx, dy);
+    steps.offset(i + 1, -dx, -dy);
   }
 
   void grow(SDL_Surface *) {
-    int dx = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
-    int dy = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
+    int dx = (randomInt() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
+    int dy = (randomInt() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
 
     int insert = 0;
     if(steps.size()) {
-      insert = rand() % steps.size();
+      insert = randomInt() % steps.size();
     }
 
-    steps.push_back({0, 0});
-    copy(steps.begin() + insert, steps.end() - 1, steps.begin() + insert + 1);
-    steps[insert] = {dx, dy};
-    steps[insert + 1].x -= dx;
-    steps[insert + 1].y -= dy;
+    steps.insert(insert, {dx, dy});
+    steps.offset(insert + 1, -dx, -dy);
   }
 
   void shrink(SDL_Surface *) {
     if(steps.size() < 2) return;
 
-    int i = rand() % (steps.size() - 1);
-    steps[i + 1].x += steps[i].x;
-    steps[i + 1].y += steps[i].y;
-    copy(steps.begin() + i + 1, steps.end(), steps.begin() + i);
-    steps.pop_back();
+    int i = randomInt() % (steps.size() - 1);
+    const Step s = steps[i];
+    steps.offset(i + 1, s.x, s.y);
+    steps.erase(i);
   }
 };
 
@@ -96,22 +100,18 @@ struct RGBW {
   int64_t getQuality() const { return quality; }
   void setQuality(int64_t q) { quality = q; }
 
-  void render(SDL_Surface *s) {
-    SDL_Renderer *rnd = SDL_CreateSoftwareRenderer(s);
-    SDL_SetRenderDrawColor(rnd, 0, 0, 0, 255);
-    SDL_RenderClear(rnd);
-
-    w.render(s, rnd);
-    r.render(s, rnd);
-    g.render(s, rnd);
-    b.render(s, rnd);
+  void render(StitchRaster &raster) const {
+    raster.clear();
 
-    SDL_RenderPresent(rnd);
-    SDL_DestroyRenderer(rnd);
+    // topmost first, b is painted over g over r over w
+    b.render(raster);
+    g.render(raster);
+    r.render(raster);
+    w.render(raster);
   }
 
   void mutate(SDL_Surface *s) {
-    switch(rand() % 4) {
+    switch(randomInt() % 4) {
       case 0: w.mutate(s); break;
       case 1: r.mutate(s); break;
       case 2: g.mutate(s); break;
@@ -122,7 +122,7 @@ struct RGBW {
   }
 
   void grow(SDL_Surface *s) {
-    switch(rand() % 4) {
+    switch(randomInt() % 4) {
       case 0: w.grow(s); break;
       case 1: r.grow(s); break;
       case 2: g.grow(s); break;
@@ -133,7 +133,7 @@ struct RGBW {
   }
 
   void shrink(SDL_Surface *s) {
-    switch(rand() % 4) {
+    switch(randomInt() % 4) {
       case 0: w.shrink(s); break;
       case 1: r.shrink(s); break;
       case 2: g.shrink(s); break;
@@ -143,13 +143,12 @@ struct RGBW {
     setQuality(NO_QUALITY);
   }
 
-  uint64_t stitchCount() {
+  uint64_t stitchCount() const {
     return r.steps.size() + g.steps.size() + b.steps.size() + w.steps.size();
   }
 
-  void initPath(Path &p, SDL_Surface *s) {
-    int distance = 5 * DEFAULT_STITCH;
-
+  // spiral of distance long steps around the centre, then perturbed a bit
+  void initPath(Path &p, SDL_Surface *s, int distance) {
     float x = s->w / 2;
     float y = s->h / 2;
     int steps = 1;
@@ -180,22 +179,22 @@ struct RGBW {
     for(int i = 0; i < 200; ++i) p.grow(s);
   }
 
-  void initPaths(SDL_Surface *s) {
-    initPath(w, s);
-    initPath(r, s);
-    initPath(g, s);
-    initPath(b, s);
+  void initPaths(SDL_Surface *s, int distance) {
+    initPath(w, s, distance);
+    initPath(r, s, distance);
+    initPath(g, s, distance);
+    initPath(b, s, distance);
+  }
+
+  void scale(int factor) {
+    w.steps.scale(factor);
+    r.steps.scale(factor);
+    g.steps.scale(factor);
+    b.steps.scale(factor);
   }
 
-  void savePaths(ostream &o) {
-    o << "White" << endl;
-    for(Path::Step &s: w.steps) o << s.x << " " << s.y << endl;
-    o << "Red" << endl;
-    for(Path::Step &s: r.steps) o << s.x << " " << s.y << endl;
-    o << "Green" << endl;
-    for(Path::Step &s: g.steps) o << s.x << " " << s.y << endl;
-    o << "Blue" << endl;
-    for(Path::Step &s: b.steps) o << s.x << " " << s.y << endl;
+  void save(const char *filename, int factor) const {
+    saveLayers(filename, w, r, g, b, factor);
   }
 };
 
@@ -206,31 +205,8 @@ uint32_t &pixel(SDL_Surface *s, int x, int y) {
   return *reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(s->pixels) + s->pitch * y + 4 * x);
 }
 
-int64_t rate(SDL_Surface *reference, SDL_Surface *rendered) {
-  int64_t value = 0;
-
-  SDL_LockSurface(rendered);
-  SDL_LockSurface(reference);
-
-  for(int y = 1; y < reference->h - 1; ++y) {
-    for(int x = 1; x < reference->w - 1; ++x) {
-      int r1 = (pixel(reference, x, y) & 0xff);
-      int r2 = (pixel(rendered, x, y) & 0xff);
-      int g1 = (pixel(reference, x, y) & 0xff00) >> 8;
-      int g2 = (pixel(rendered, x, y) & 0xff00) >> 8;
-      int b1 = (pixel(reference, x, y) & 0xff0000) >> 16;
-      int b2 = (pixel(rendered, x, y) & 0xff0000) >> 16;
-
-      value -= (r1 - r2) * (r1 - r2) +
-               (g1 - g2) * (g1 - g2) +
-               (b1 - b2) * (b1 - b2);
-    }
-  }
-
-  SDL_UnlockSurface(reference);
-  SDL_UnlockSurface(rendered);
-
-  return value;
+int64_t rate(const PlanarImage &reference, const PlanarImage &rendered) {
+  return -sumSquaredDifferences(reference, rendered, 1, 1, reference.w - 1, reference.h - 1);
 }
 
 Path generateRandomPath(SDL_Surface *s, int r, int g, int b) {
@@ -243,8 +219,8 @@ Path generateRandomPath(SDL_Surface *s, int r, int g, int b) {
   int y = s->h / 2;
 
   for(int i = 0; i < s->w * s->h / DEFAULT_STITCH; ++i) {
-    int rx = (rand() % (2 * DEFAULT_STITCH + 1)) - DEFAULT_STITCH;
-    int ry = (rand() % (2 * DEFAULT_STITCH + 1)) - DEFAULT_STITCH;
+    int rx = (randomInt() % (2 * DEFAULT_STITCH + 1)) - DEFAULT_STITCH;
+    int ry = (randomInt() % (2 * DEFAULT_STITCH + 1)) - DEFAULT_STITCH;
 
     if(x + rx >= 0 && x + rx < s->w &&
         y + ry >= 0 && y + ry < s->h) {
@@ -265,41 +241,20 @@ uint64_t time() {
   return tv.tv_sec * 1000000ull + tv.tv_usec;
 }
 
-void simulateRGBView(SDL_Surface *src, SDL_Surface *dst) {
-  SDL_LockSurface(src);
-  SDL_LockSurface(dst);
-
-  for(int y = 0; y < dst->h; ++y) {
-    for(int x = 0; x < dst->w; ++x) {
-      int r = 0, g = 0, b = 0;
-
-      for(int yy = 0; yy < SCALE; ++yy) {
-        for(int xx = 0; xx < SCALE; ++xx) {
-          r += pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff;
-          g += (pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff00) >> 8;
-          b += (pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff0000) >> 16;
-        }
-      }
-
-      pixel(dst, x, y) =
-        r / (SCALE * SCALE) + 
-        g / (SCALE * SCALE) * 0x100 + 
-        b / (SCALE * SCALE) * 0x10000 +
-        0xff000000ull;
-    }
-  }
-
-  SDL_UnlockSurface(dst);
-  SDL_UnlockSurface(src);
+void simulateRGBView(SDL_Surface *src, IntegralImage &integral, PlanarImage &dst) {
+  StageTimers::Scope timer(stageTimers(), STAGE_DOWNSAMPLE);
+  integral.build(src);
+  downsampleBlock(integral, SCALE, dst);
 }
 
 RGBW cross(SDL_Surface *, RGBW &a, RGBW &b) {
+  StageTimers::Scope timer(stageTimers(), STAGE_CROSSOVER);
   RGBW ret = a;
   ret.setQuality(NO_QUALITY);
 
   Path *ap = 0, *bp = 0, *rp = 0;
 
-  switch(rand() % 4) {
+  switch(randomInt() % 4) {
     case 0: ap = &a.w; bp = &b.w; rp = &ret.w; break;
     case 1: ap = &a.r; bp = &b.r; rp = &ret.r; break;
     case 2: ap = &a.g; bp = &b.g; rp = &ret.g; break;
@@ -307,63 +262,163 @@ RGBW cross(SDL_Surface *, RGBW &a, RGBW &b) {
   }
 
   vector<pair<size_t, size_t>> possiblePoints;
+  vector<size_t> near;
+
+  // only b's vertices in the cells around each vertex of a are looked at
+  const VertexGrid grid(bp->steps, DEFAULT_STITCH);
 
   int ax = 0;
   int ay = 0;
+  size_t ai = 0;
 
-  for(size_t ai = 0; ai < ap->steps.size(); ++ai) {
-    ax += ap->steps[ai].x;
-    ay += ap->steps[ai].y;
-
-    int bx = 0;
-    int by = 0;
-
-    for(size_t bi = 0; bi < bp->steps.size(); ++bi) {
-      bx += bp->steps[bi].x;
-      by += bp->steps[bi].y;
+  for(const Path::Step &s: ap->steps) {
+    ax += s.x;
+    ay += s.y;
 
-      if((ax - bx) * (ax - bx) < DEFAULT_STITCH * DEFAULT_STITCH &&
-         (ay - by) * (ay - by) < DEFAULT_STITCH * DEFAULT_STITCH) {
-        possiblePoints.push_back({ai, bi});
-      }
-    }
+    grid.near(ax, ay, near);
+    for(size_t bi: near) possiblePoints.push_back({ai, bi});
+    ++ai;
   }
 
   if(possiblePoints.empty()) return ret;
 
-  auto &crossover = possiblePoints[rand() % possiblePoints.size()];
+  auto &crossover = possiblePoints[randomInt() % possiblePoints.size()];
 
-  while(rp->steps.size() > crossover.first) {
-    rp->steps.pop_back();
-  }
+  rp->steps.truncate(crossover.first);
 
-  ax = ay = 0;
+  const Path::Step from = rp->steps.position(rp->steps.size());
+  const Path::Step to = bp->steps.position(crossover.second);
 
-  int bx = 0;
-  int by = 0;
+  rp->steps.push_back({to.x - from.x, to.y - from.y});
 
-  for(auto &s: rp->steps) {
-    ax += s.x;
-    ay += s.y;
+  size_t i = 0;
+  for(const Path::Step &s: bp->steps) {
+    if(i++ >= crossover.second) rp->steps.push_back(s);
   }
 
-  for(size_t i = 0; i < crossover.second; ++i) {
-    bx += bp->steps[i].x;
-    by += bp->steps[i].y;
+  return ret;
+}
+
+// shared between the islands and the main thread, guarded by lock
+struct Archipelago {
+  mutex lock;
+  vector<RGBW> best;      // best individual of each island so far
+  vector<int64_t> worst;  // worst individual of each island's latest generation
+  vector<RGBW> migrants;  // best individual of the previous island in the ring, waiting to be adopted
+  vector<bool> arrived;
+  atomic<bool> running;
+  atomic<uint64_t> generations;
+  int migrationInterval;
+
+  Archipelago(size_t islands, int interval, uint64_t previousGenerations):
+    best(islands), worst(islands, NO_QUALITY), migrants(islands), arrived(islands, false), running(true),
+    generations(previousGenerations), migrationInterval(interval) { }
+};
+
+// starts from copies of seed, or from spirals of distance long steps if it has no stitches
+void evolve(Archipelago &archipelago, size_t island, SDL_Surface *img, const PlanarImage &zoomedImg, const RGBW &seed, int distance) {
+  rng.seed((batch().seeded? batch().seed: 1) + island);
+
+  StitchRaster raster(img->w, img->h, SCALE);
+  PlanarImage zoomed;
+
+  std::vector<RGBW> population;
+
+  for(int i = 0; i < POPULATION_SIZE; ++i) {
+    population.push_back(seed);
+    if(!seed.stitchCount()) population.back().initPaths(img, distance);
   }
 
-  rp->steps.push_back({bx - ax, by - ay});
+  const size_t islands = archipelago.best.size();
+  int64_t published = NO_QUALITY;
+
+  // checking the budget here keeps runs with one island repeatable
+  for(int generation = 1; archipelago.running && !batch().exhausted(archipelago.generations); ++generation) {
+    for(RGBW &rgbw: population) {
+      if(rgbw.getQuality() == NO_QUALITY) {
+        StageTimers &timers = stageTimers();
+        {
+          StageTimers::Scope timer(timers, STAGE_RENDER);
+          rgbw.render(raster);
+        }
+        {
+          StageTimers::Scope timer(timers, STAGE_DOWNSAMPLE);
+          raster.downsample(zoomed);
+        }
+        {
+          StageTimers::Scope timer(timers, STAGE_RATE);
+          rgbw.setQuality(rate(zoomedImg, zoomed) - rgbw.stitchCount() * STITCH_COST);
+        }
+        timers.count(COUNT_CANDIDATES);
+      }
+    }
+
+    sort(population.begin(), population.end(), [](const RGBW &a, const RGBW &b) {
+        return a.getQuality() < b.getQuality();
+    });
+
+    ++archipelago.generations;
+    stageTimers().count(COUNT_GENERATIONS);
+
+    {
+      lock_guard<mutex> guard(archipelago.lock);
+      archipelago.worst[island] = population.front().getQuality();
+    }
+
+    if(population.back().getQuality() > published) {
+      stageTimers().count(COUNT_ACCEPTED);
+      lock_guard<mutex> guard(archipelago.lock);
+      archipelago.best[island] = population.back();
+      published = population.back().getQuality();
+    }
+
+    if(islands > 1 && generation % archipelago.migrationInterval == 0) {
+      lock_guard<mutex> guard(archipelago.lock);
+
+      archipelago.migrants[(island + 1) % islands] = population.back();
+      archipelago.arrived[(island + 1) % islands] = true;
+
+      if(archipelago.arrived[island]) {
+        // replaces the worst survivor, the lower half is bred over below
+        population[POPULATION_SIZE / 2] = archipelago.migrants[island];
+        archipelago.arrived[island] = false;
+      }
+    }
+
+    for(int i = 0; i < POPULATION_SIZE / 2; ++i) {
+      int sel = randomInt() % 100;
+      int ai = POPULATION_SIZE / 2 + (randomInt() % (POPULATION_SIZE / 2));
+
+      if(sel < 10) {
+        population[i] = population[ai];
+        for(int j = 0; j < 10; ++j) population[i].mutate(img);
+      } else if(sel < 20) {
+        population[i] = population[ai];
+        for(int j = 0; j < 10; ++j) population[i].grow(img);
+      } else if(sel < 40) {
+        population[i] = population[ai];
+        population[i].mutate(img);
+      } else if(sel < 60) {
+        population[i] = population[ai];
+        population[i].grow(img);
+      } else if(sel < 80) {
+        population[i] = population[ai];
+        population[i].shrink(img);
+      } else {
+        int bi = POPULATION_SIZE / 2 + (randomInt() % (POPULATION_SIZE / 2));
 
-  for(size_t i = crossover.second; i < bp->steps.size(); ++i) {
-    rp->steps.push_back(bp->steps[i]);
+        population[i] = cross(img, population[ai], population[bi]);
+      }
+    }
   }
 
-  return ret;
 }
 
 int main(int argc, const char *const argv[]) {
-  if(argc != 5) {
-    cerr << "usage: ./path-evolving <scale reduction (try 3)> <default stitch size (try 10)> <input image> <output.p>" << endl;
+  if(argc < 5 || argc > 9) {
+    cerr << "usage: ./path-evolving <scale reduction (try 3)> <default stitch size (try 10)> <input image> <output.p or output.vp3> "
+      "[islands (default: one per core)] [migration interval in generations (try 20)] "
+      "[coarse levels (default: 0)] [seconds per coarse level (try 60)]" << endl;
     return 1;
   }
 
@@ -373,10 +428,33 @@ int main(int argc, const char *const argv[]) {
   istringstream default_stitch(argv[2]);
   default_stitch >> DEFAULT_STITCH;
 
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    cerr << "Could not init SDL: " << SDL_GetError() << endl;
-    return 1;
+  size_t islands = thread::hardware_concurrency();
+  if(argc > 5) {
+    istringstream islands_arg(argv[5]);
+    islands_arg >> islands;
+  }
+  if(islands < 1) islands = 1;
+
+  int migrationInterval = 20;
+  if(argc > 6) {
+    istringstream migration_arg(argv[6]);
+    migration_arg >> migrationInterval;
   }
+  if(migrationInterval < 1) migrationInterval = 1;
+
+  int levels = 0;
+  if(argc > 7) {
+    istringstream levels_arg(argv[7]);
+    levels_arg >> levels;
+  }
+
+  int levelSeconds = 60;
+  if(argc > 8) {
+    istringstream seconds_arg(argv[8]);
+    seconds_arg >> levelSeconds;
+  }
+
+  if(!Display::init()) return 1;
 
   const int allFormats = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF;
   if(!IMG_Init(allFormats)) {
@@ -397,97 +475,107 @@ int main(int argc, const char *const argv[]) {
   }
   SDL_BlitSurface(rawImg, 0, img, 0);
 
-  SDL_Surface *const zoomedImg = SDL_CreateRGBSurface(0, img->w / SCALE, img->h / SCALE, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
-  simulateRGBView(img, zoomedImg);
+  Pyramid pyramid(img, SCALE, levels, levelSeconds, LEVEL_PATIENCE);
 
-  SDL_Window *const win = SDL_CreateWindow("path-evolving", 0, 0, img->w / SCALE, img->h / SCALE, 0);
-  if(!win) {
-    cerr << "Could not open window" << endl;
-    return 1;
-  }
+  Display display;
+  if(!display.open("path-evolving", img->w / SCALE, img->h / SCALE)) return 1;
 
-  SDL_Surface *const screen = SDL_GetWindowSurface(win);
-  if(!screen) {
-    cerr << "Could not get screen surface" << endl;
-    return 1;
-  }
+  bool running = true;
+  uint64_t last = time();
+  uint64_t generations = 0;
+  RGBW best;
 
-  SDL_Surface *const tmp = SDL_CreateRGBSurface(0, img->w, img->h, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
-  SDL_Surface *const zoomed = SDL_CreateRGBSurface(0, img->w / SCALE, img->h / SCALE, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+  while(running) {
+    SDL_Surface *const levelImg = pyramid.image();
 
-  std::vector<RGBW> population;
+    IntegralImage integral;
+    PlanarImage zoomedImg;
+    simulateRGBView(levelImg, integral, zoomedImg);
 
-  for(int i = 0; i < POPULATION_SIZE; ++i) {
-    population.push_back(RGBW());
-    population.back().initPaths(tmp);
-  }
+    StitchRaster raster(levelImg->w, levelImg->h, SCALE);
+    SDL_Surface *const zoomedScreen = SDL_CreateRGBSurface(0, zoomedImg.w, zoomedImg.h, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+    PlanarImage zoomed;
 
-  SDL_Event event;
-  bool running = true;
-  uint64_t last = time();
+    // the best individual of the previous level, its rating does not carry over: the copies
+    // seeding the islands have to be rated against this level's image like any other
+    RGBW seed = best;
+    seed.setQuality(NO_QUALITY);
+    best.setQuality(NO_QUALITY);
 
-  int stage = 0;
+    Archipelago archipelago(islands, migrationInterval, generations);
+    vector<thread> threads;
 
-  while(running) {
-    while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT: running = false;
-      }
+    for(size_t i = 0; i < islands; ++i) {
+      threads.push_back(thread(evolve, ref(archipelago), i, levelImg, cref(zoomedImg), cref(seed), pyramid.shrink(5 * DEFAULT_STITCH)));
     }
 
-    for(RGBW &rgbw: population) {
-      if(rgbw.getQuality() == NO_QUALITY) {
-        rgbw.render(tmp);
-        simulateRGBView(tmp, zoomed);
-        rgbw.setQuality(rate(zoomedImg, zoomed) - rgbw.stitchCount() * STITCH_COST);
+    while(archipelago.running) {
+      if(display.closed() || batch().exhausted(archipelago.generations)) {
+        running = archipelago.running = false;
       }
-    }
 
-    sort(population.begin(), population.end(), [](const RGBW &a, const RGBW &b) {
-        return a.getQuality() < b.getQuality();
-    });
+      if(time() > last + 1000000ull) {
+        int64_t worst = -NO_QUALITY;
+        bool improved = false;
 
-    if(time() > last + 1000000ull) {
-      cout << population.front().getQuality() << " - " << population.back().getQuality() <<
-        " / " << stage << " / " << population.back().stitchCount() << endl;
+        {
+          lock_guard<mutex> guard(archipelago.lock);
 
-      population.back().render(tmp);
-      simulateRGBView(tmp, zoomed);
-      SDL_BlitSurface(zoomed, 0, screen, 0);
-      SDL_UpdateWindowSurface(win);
+          for(RGBW &rgbw: archipelago.best) {
+            if(rgbw.getQuality() > best.getQuality()) {
+              best = rgbw;
+              improved = true;
+            }
+          }
 
-      ofstream vp3(argv[4]);
-      population.back().savePaths(vp3);
+          for(int64_t q: archipelago.worst) {
+            if(q != NO_QUALITY && q < worst) worst = q;
+          }
+        }
 
-      last = time();
-    }
+        if(best.getQuality() != NO_QUALITY) {
+          cout << worst << " - " << best.getQuality() <<
+            " / " << archipelago.generations << " / " << best.stitchCount() << endl;
 
-    for(int i = 0; i < POPULATION_SIZE / 2; ++i) {
-      int sel = rand() % 100;
-      int ai = POPULATION_SIZE / 2 + (rand() % (POPULATION_SIZE / 2));
+          if(display.visible()) {
+            best.render(raster);
+            raster.downsample(zoomed);
+            zoomed.toSurface(zoomedScreen);
+            display.show(zoomedScreen);
+          }
 
-      if(sel < 10) {
-        population[i] = population[ai];
-        for(int j = 0; j < 10; ++j) population[i].mutate(img);
-      } else if(sel < 20) {
-        population[i] = population[ai];
-        for(int j = 0; j < 10; ++j) population[i].grow(img);
-      } else if(sel < 40) {
-        population[i] = population[ai];
-        population[i].mutate(img);
-      } else if(sel < 60) {
-        population[i] = population[ai];
-        population[i].grow(img);
-      } else if(sel < 80) {
-        population[i] = population[ai];
-        population[i].shrink(img);
-      } else {
-        int bi = POPULATION_SIZE / 2 + (rand() % (POPULATION_SIZE / 2));
+          best.save(argv[4], pyramid.factor());
+        }
 
-        population[i] = cross(img, population[ai], population[bi]);
+        pyramid.update(improved);
+        if(pyramid.converged()) archipelago.running = false;
+
+        last = time();
       }
+
+      SDL_Delay(10);
+    }
+
+    for(thread &t: threads) t.join();
+
+    SDL_FreeSurface(zoomedScreen);
+    generations = archipelago.generations;
+
+    // the islands may have found better ones since the last look
+    for(RGBW &rgbw: archipelago.best) {
+      if(rgbw.getQuality() > best.getQuality()) best = rgbw;
+    }
+
+    if(running) {
+      pyramid.descend();
+      best.scale(2);
+      stageTimers().count(COUNT_LEVELS);
+      cout << "level 1/" << pyramid.factor() << endl;
     }
   }
 
+  best.save(argv[4], pyramid.factor());
+  batch().writeStats("path-evolving", argv[3], best.stitchCount(), true, best.getQuality());
+
   atexit(SDL_Quit);
 }
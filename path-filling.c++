@@ -9,6 +9,9 @@
 #include <sstream>
 #include <unistd.h>
 
+#include "batch.h"
+#include "regions.h"
+
 #define STITCH_COST 10
 #define MAXSTITCH 20
 int SCALE = 3;
@@ -68,10 +71,7 @@ int main(int argc, const char *const argv[]) {
   istringstream default_stitch(argv[1]);
   default_stitch >> DEFAULT_STITCH;
 
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    cerr << "Could not init SDL: " << SDL_GetError() << endl;
-    return 1;
-  }
+  if(!Display::init()) return 1;
 
   const int allFormats = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF;
   if(!IMG_Init(allFormats)) {
@@ -92,23 +92,14 @@ int main(int argc, const char *const argv[]) {
   }
   SDL_BlitSurface(rawImg, 0, img, 0);
 
-  SDL_Window *const win = SDL_CreateWindow("path-guessing", 0, 0, img->w, img->h, 0);
-  if(!win) {
-    cerr << "Could not open window" << endl;
-    return 1;
-  }
-
-  SDL_Surface *const screen = SDL_GetWindowSurface(win);
-  if(!screen) {
-    cerr << "Could not get screen surface" << endl;
-    return 1;
-  }
+  Display display;
+  if(!display.open("path-guessing", img->w, img->h)) return 1;
 
   atexit(SDL_Quit);
 
   Path path;
+  FillRegions regions(img);
 
-  SDL_Event event;
   bool running = true;
   uint64_t last = time();
 
@@ -119,31 +110,13 @@ int main(int argc, const char *const argv[]) {
   int dir = 0;
 
   while(running) {
-    while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT: running = false;
-      }
-    }
+    if(display.closed()) running = false;
 
     if(!(pixel(img, cx, cy) & 0xff)) {
-      int bestX = -1;
-      int bestY = -1;
-      int bestDist = 999999999;
-
-      for(int y = 0; y < img->h; ++y) {
-        for(int x = 0; x < img->w; ++x) {
-          if(pixel(img, x, y) & 0xff) {
-            int dist = (cx - x) * (cx - x) + (cy - y) * (cy - y);
-            if(dist < bestDist) {
-              bestX = x;
-              bestY = y;
-              bestDist = dist;
-            }
-          }
-        }
-      }
+      int bestX;
+      int bestY;
 
-      if(bestX >= 0) {
+      if(regions.nearest(cx, cy, bestX, bestY)) {
         cx = bestX;
         cy = bestY;
         if(oy < 0 || ox < 0) {
@@ -157,6 +130,7 @@ int main(int argc, const char *const argv[]) {
 
     for(int i = 0; i < MAXSTITCH; ++i) {
       pixel(img, cx, cy) = 0xff800000ul;
+      regions.remove(cx, cy);
 
       for(int j = 0; !(pixel(img, cx + dirx(dir), cy + diry(dir)) & 0xff) && j < 9; ++j, dir = (dir + 7) % 8);
       for(; pixel(img, cx + dirx(dir + 1), cy + diry(dir + 1)) & 0xff; dir = (dir + 1) % 8);
@@ -178,8 +152,7 @@ int main(int argc, const char *const argv[]) {
 
     if(time() > last + 1000000ull) {
       // SDL_BlitSurface(zoomedImg, 0, screen, 0);
-      SDL_BlitSurface(img, 0, screen, 0);
-      SDL_UpdateWindowSurface(win);
+      display.show(img);
 
       last = time();
     }
@@ -189,8 +162,9 @@ int main(int argc, const char *const argv[]) {
   vp3 << "White" << endl;
   for(Path::Step &s: path.steps) vp3 << s.x << " " << s.y << endl;
 
-  SDL_BlitSurface(img, 0, screen, 0);
-  SDL_UpdateWindowSurface(win);
+  display.show(img);
+
+  batch().writeStats("path-filling", argv[2], path.steps.size());
 
-  sleep(5);
+  if(!batch().headless) sleep(5);
 }
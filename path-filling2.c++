@@ -9,6 +9,9 @@
 #include <sstream>
 #include <unistd.h>
 
+#include "batch.h"
+#include "regions.h"
+
 #define STITCH_COST 10
 #define MINSTITCH 20
 #define MAXSTITCH 70
@@ -63,35 +66,6 @@ int diry(int dir) {
   return DY[dir % 8];
 }
 
-int remainingAreaRec(SDL_Surface *img, int x, int y, int area) {
-  if(area <= 0) return 0;
-
-  pixel(img, x, y) |= 0x0100;
-  --area;
-
-  for(int dy = -1; dy < 2; ++dy) {
-    for(int dx = -1; dx < 2; ++dx) {
-      if(y + dy < 0 || y + dy >= img->h || x + dx < 0 || x + dx >= img->w) continue;
-
-      if(pixel(img, x + dx, y + dy) & 0xff && !(pixel(img, x + dx, y + dy) & 0xff00)) {
-        area = remainingAreaRec(img, x + dx, y + dy, area);
-      }
-    }
-  }
-
-  return area;
-}
-
-bool hasAreaAbove(SDL_Surface *img, int x, int y, int area) {
-  for(int y = 0; y < img->h; ++y) {
-    for(int x = 0; x < img->w; ++x) {
-      pixel(img, x, y) &= 0xffff00fful;
-    }
-  }
-
-  return remainingAreaRec(img, x, y, area) == 0;
-}
-
 int main(int argc, const char *const argv[]) {
   if(argc != 3) {
     cerr << "usage: ./path-filling <input image> <output.p>" << endl;
@@ -101,10 +75,9 @@ int main(int argc, const char *const argv[]) {
   istringstream default_stitch(argv[1]);
   default_stitch >> DEFAULT_STITCH;
 
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    cerr << "Could not init SDL: " << SDL_GetError() << endl;
-    return 1;
-  }
+  if(batch().seeded) srand(batch().seed);
+
+  if(!Display::init()) return 1;
 
   const int allFormats = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF;
   if(!IMG_Init(allFormats)) {
@@ -125,23 +98,14 @@ int main(int argc, const char *const argv[]) {
   }
   SDL_BlitSurface(rawImg, 0, img, 0);
 
-  SDL_Window *const win = SDL_CreateWindow("path-guessing", 0, 0, img->w, img->h, 0);
-  if(!win) {
-    cerr << "Could not open window" << endl;
-    return 1;
-  }
-
-  SDL_Surface *const screen = SDL_GetWindowSurface(win);
-  if(!screen) {
-    cerr << "Could not get screen surface" << endl;
-    return 1;
-  }
+  Display display;
+  if(!display.open("path-guessing", img->w, img->h)) return 1;
 
   atexit(SDL_Quit);
 
   Path path;
+  FillRegions regions(img);
 
-  SDL_Event event;
   bool running = true;
   uint64_t last = time();
 
@@ -152,44 +116,23 @@ int main(int argc, const char *const argv[]) {
   int dir = 0;
 
   while(running) {
-    while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT: running = false;
-      }
-    }
+    if(display.closed()) running = false;
 
     if(!(pixel(img, cx, cy) & 0xff)) {
       bool found;
 
       int bestX;
       int bestY;
-      int bestDist;
 
       do {
         found = true;
 
-        bestX = -1;
-        bestY = -1;
-        bestDist = 999999999;
-
-        for(int y = 0; y < img->h; ++y) {
-          for(int x = 0; x < img->w; ++x) {
-            if(pixel(img, x, y) & 0xff) {
-              int dist = (cx - x) * (cx - x) + (cy - y) * (cy - y);
-              if(dist < bestDist) {
-                bestX = x;
-                bestY = y;
-                bestDist = dist;
-              }
-            }
-          }
-        }
-
-        if(bestX >= 0) {
-          if(!hasAreaAbove(img, bestX, bestY, MINAREA)) {
-            pixel(img, bestX, bestY) = 0xff00ff00ul;
-            found = false;
-          }
+        if(!regions.nearest(cx, cy, bestX, bestY)) {
+          bestX = -1;
+        } else if(!regions.hasAreaAbove(bestX, bestY, MINAREA)) {
+          pixel(img, bestX, bestY) = 0xff00ff00ul;
+          regions.remove(bestX, bestY);
+          found = false;
         }
       } while(!found);
 
@@ -213,6 +156,7 @@ int main(int argc, const char *const argv[]) {
 
     for(int i = 0; i < maxStitch; ++i) {
       pixel(img, cx, cy) = 0xff800000ul;
+      regions.remove(cx, cy);
 
       for(int j = 0; !(pixel(img, cx + dirx(dir), cy + diry(dir)) & 0xff) && j < 9; ++j, dir = (dir + 7) % 8);
       for(; pixel(img, cx + dirx(dir + 1), cy + diry(dir + 1)) & 0xff; dir = (dir + 1) % 8);
@@ -242,8 +186,7 @@ int main(int argc, const char *const argv[]) {
 
     if(time() > last + 1000000ull) {
       // SDL_BlitSurface(zoomedImg, 0, screen, 0);
-      SDL_BlitSurface(img, 0, screen, 0);
-      SDL_UpdateWindowSurface(win);
+      display.show(img);
 
       last = time();
     }
@@ -253,10 +196,11 @@ int main(int argc, const char *const argv[]) {
   vp3 << "White" << endl;
   for(Path::Step &s: path.steps) vp3 << s.x << " " << s.y << endl;
 
-  SDL_BlitSurface(img, 0, screen, 0);
-  SDL_UpdateWindowSurface(win);
+  display.show(img);
 
   std::cout << "Total stitch count: " << path.steps.size() << std::endl;
 
-  sleep(5);
+  batch().writeStats("path-filling2", argv[1], path.steps.size());
+
+  if(!batch().headless) sleep(5);
 }
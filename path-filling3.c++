@@ -9,6 +9,9 @@
 #include <sstream>
 #include <unistd.h>
 
+#include "batch.h"
+#include "regions.h"
+
 #define STITCH_COST 10
 #define MINSTITCH 20
 #define MAXSTITCH 70
@@ -53,85 +56,14 @@ uint64_t time() {
   return tv.tv_sec * 1000000ull + tv.tv_usec;
 }
 
-int remainingAreaRec(SDL_Surface *img, int x, int y, int area) {
-  if(area <= 0) return 0;
-
-  pixel(img, x, y) |= 0x0100;
-  --area;
-
-  for(int dy = -1; dy < 2; ++dy) {
-    for(int dx = -1; dx < 2; ++dx) {
-      if(y + dy < 0 || y + dy >= img->h || x + dx < 0 || x + dx >= img->w) continue;
-
-      if(pixel(img, x + dx, y + dy) & 0xff && !(pixel(img, x + dx, y + dy) & 0xff00)) {
-        area = remainingAreaRec(img, x + dx, y + dy, area);
-      }
-    }
-  }
-
-  return area;
-}
-
-bool hasAreaAbove(SDL_Surface *img, int x, int y, int area) {
-  for(int y = 0; y < img->h; ++y) {
-    for(int x = 0; x < img->w; ++x) {
-      pixel(img, x, y) &= 0xffff00fful;
-    }
-  }
-
-  return remainingAreaRec(img, x, y, area) == 0;
-}
-
-void moveToTopLeftRec(SDL_Surface *img, int &x, int &y, int sx, int sy) {
-  pixel(img, sx, sy) |= 0x0100;
-  if(sy < y || (sy == y && sx < x)) {
-    y = sy;
-    x = sx;
-  }
-
-  for(int dy = -1; dy < 2; ++dy) {
-    for(int dx = -1; dx < 2; ++dx) {
-      if(sy + dy < 0 || sy + dy >= img->h || sx + dx < 0 || sx + dx >= img->w) continue;
-
-      if(pixel(img, sx + dx, sy + dy) & 0xff && !(pixel(img, sx + dx, sy + dy) & 0xff00)) {
-        moveToTopLeftRec(img, x, y, sx + dx, sy + dy);
-      }
-    }
-  }
-}
-
-void moveToTopLeft(SDL_Surface *img, int &x, int &y) {
-  for(int sy = 0; sy < img->h; ++sy) {
-    for(int sx = 0; sx < img->w; ++sx) {
-      pixel(img, sx, sy) &= 0xffff00fful;
-    }
-  }
+bool findStart(SDL_Surface *img, FillRegions &regions, int &cx, int &cy, int &ox, int &oy, Path &path) {
+  int bestX;
+  int bestY;
 
-  moveToTopLeftRec(img, x, y, x, y);
-}
-
-bool findStart(SDL_Surface *img, int &cx, int &cy, int &ox, int &oy, Path &path) {
-  int bestX = -1;
-  int bestY = -1;
-  int bestDist = 999999999;
-
-  for(int y = 0; y < img->h; ++y) {
-    for(int x = 0; x < img->w; ++x) {
-      if(pixel(img, x, y) & 0xff) {
-        int dist = (cx - x) * (cx - x) + (cy - y) * (cy - y);
-        if(dist < bestDist) {
-          bestX = x;
-          bestY = y;
-          bestDist = dist;
-        }
-      }
-    }
-  }
-
-  if(bestX < 0) return false;
+  if(!regions.nearest(cx, cy, bestX, bestY)) return false;
 
   std::cerr << "before: " << bestX << "," << bestY << std::endl;
-  moveToTopLeft(img, bestX, bestY);
+  regions.moveToTopLeft(bestX, bestY);
   std::cerr << "after: " << bestX << "," << bestY << std::endl;
   if(!(pixel(img, bestX, bestY) & 0xff)) {
     std::cerr << "wrong" << pixel(img, bestX, bestY) << std::endl;
@@ -159,10 +91,9 @@ int main(int argc, const char *const argv[]) {
   istringstream default_stitch(argv[1]);
   default_stitch >> DEFAULT_STITCH;
 
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    cerr << "Could not init SDL: " << SDL_GetError() << endl;
-    return 1;
-  }
+  if(batch().seeded) srand(batch().seed);
+
+  if(!Display::init()) return 1;
 
   const int allFormats = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF;
   if(!IMG_Init(allFormats)) {
@@ -183,23 +114,14 @@ int main(int argc, const char *const argv[]) {
   }
   SDL_BlitSurface(rawImg, 0, img, 0);
 
-  SDL_Window *const win = SDL_CreateWindow("path-guessing", 0, 0, img->w, img->h, 0);
-  if(!win) {
-    cerr << "Could not open window" << endl;
-    return 1;
-  }
-
-  SDL_Surface *const screen = SDL_GetWindowSurface(win);
-  if(!screen) {
-    cerr << "Could not get screen surface" << endl;
-    return 1;
-  }
+  Display display;
+  if(!display.open("path-guessing", img->w, img->h)) return 1;
 
   atexit(SDL_Quit);
 
   Path path;
+  FillRegions regions(img);
 
-  SDL_Event event;
   uint64_t last = time();
 
   int cx = 0;
@@ -214,14 +136,10 @@ int main(int argc, const char *const argv[]) {
 #define MODE_LEFTBACKSCAN 5
   int mode = 0;
 
-  bool running = findStart(img, cx, cy, ox, oy, path);
+  bool running = findStart(img, regions, cx, cy, ox, oy, path);
 
   while(running) {
-    while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT: running = false;
-      }
-    }
+    if(display.closed()) running = false;
 
     int maxStitch = (rand() % (MAXSTITCH - MINSTITCH)) + MINSTITCH;
 
@@ -229,6 +147,7 @@ int main(int argc, const char *const argv[]) {
       switch(mode) {
         case MODE_RIGHT:
           pixel(img, cx, cy) = 0xff800000ul;
+          regions.remove(cx, cy);
           if(pixel(img, cx + 1, cy) & 0xff) {
             ++cx;
           } else {
@@ -256,12 +175,13 @@ int main(int argc, const char *const argv[]) {
           } else if(pixel(img, cx - 1, cy - 1) & 0xff0000) {
             --cx;
           } else {
-            running = findStart(img, cx, cy, ox, oy, path);
+            running = findStart(img, regions, cx, cy, ox, oy, path);
             mode = MODE_RIGHT;
           }
           break;
         case MODE_LEFT:
           pixel(img, cx, cy) = 0xff800000ul;
+          regions.remove(cx, cy);
           if(pixel(img, cx - 1, cy) & 0xff) {
             --cx;
           } else {
@@ -289,7 +209,7 @@ int main(int argc, const char *const argv[]) {
           } else if(pixel(img, cx + 1, cy - 1) & 0xff0000) {
             ++cx;
           } else {
-            running = findStart(img, cx, cy, ox, oy, path);
+            running = findStart(img, regions, cx, cy, ox, oy, path);
             mode = MODE_RIGHT;
           }
           break;
@@ -309,8 +229,7 @@ int main(int argc, const char *const argv[]) {
 
     if(time() > last + 1000000ull) {
       // SDL_BlitSurface(zoomedImg, 0, screen, 0);
-      SDL_BlitSurface(img, 0, screen, 0);
-      SDL_UpdateWindowSurface(win);
+      display.show(img);
 
       last = time();
     }
@@ -320,10 +239,11 @@ int main(int argc, const char *const argv[]) {
   vp3 << "White" << endl;
   for(Path::Step &s: path.steps) vp3 << s.x << " " << s.y << endl;
 
-  SDL_BlitSurface(img, 0, screen, 0);
-  SDL_UpdateWindowSurface(win);
+  display.show(img);
 
   std::cout << "Total stitch count: " << path.steps.size() << std::endl;
 
-  sleep(5);
+  batch().writeStats("path-filling3", argv[1], path.steps.size());
+
+  if(!batch().headless) sleep(5);
 }
@@ -8,49 +8,41 @@
 #include <fstream>
 #include <sstream>
 
+#include "batch.h"
+#include "incremental-rating.h"
+#include "path.h"
+#include "planar-image.h"
+#include "pyramid.h"
+#include "stage-timers.h"
+#include "vp3.h"
+
 #define STITCH_COST 10
 #define MAXSTITCH 20
+#define LEVEL_PATIENCE 20000 // candidates in a row without improvement before the next finer level
 int SCALE = 3;
 int DEFAULT_STITCH = 10;
 
 using namespace std;
 
 struct Path {
-  struct Step {
-    int x, y;
-  };
+  typedef Steps::Step Step;
+  typedef Steps::Change Change;
 
-  std::vector<Step> steps;
+  Steps steps;
   unsigned int r, g, b;
 
-  void render(SDL_Surface *s, SDL_Renderer *rnd) {
-    SDL_SetRenderDrawColor(rnd, r, g, b, 255);
-
-    int x = s->w / 2;
-    int y = s->h / 2;
-
-    for(Step &s: steps) {
-      SDL_RenderDrawLine(rnd, x, y, x + s.x, y + s.y);
-      x += s.x;
-      y += s.y;
-    }
-  }
+  Change mutate(SDL_Surface *) {
+    if(steps.size() < 20) return {0, 0, 0, {}};
 
-  void mutate(SDL_Surface *) {
-    if(steps.size() < 20) return;
-    
     int i = 1 + (rand() % (steps.size() - 2));
 
     int dx = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
     int dy = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
 
-    steps[i].x += dx;
-    steps[i].y += dy;
-    steps[i + 1].x -= dx;
-    steps[i + 1].y -= dy;
+    return steps.moveVertex(i, dx, dy);
   }
 
-  void grow(SDL_Surface *) {
+  Change grow(SDL_Surface *) {
     int dx = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
     int dy = (rand() % (2 * MAXSTITCH + 1)) - MAXSTITCH;
 
@@ -59,17 +51,18 @@ struct Path {
       insert = rand() % steps.size();
     }
 
-    steps.push_back({0, 0});
-    copy(steps.begin() + insert, steps.end(), steps.begin() + insert + 1);
-    steps[insert] = {dx, dy};
-    steps[insert + 1].x -= dx;
-    steps[insert + 1].y -= dy;
+    return steps.insertVertex(insert, dx, dy);
   }
 };
 
 struct RGBW {
   Path r, g, b, w;
 
+  struct Change {
+    int layer;
+    Path::Change steps;
+  };
+
   RGBW() {
     r.r = 255; r.g =   0; r.b =   0;
     g.r =   0; g.g = 255; g.b =   0;
@@ -77,21 +70,17 @@ struct RGBW {
     w.r = 255; w.g = 255; w.b = 255;
   }
 
-  void render(SDL_Surface *s) {
-    SDL_Renderer *rnd = SDL_CreateSoftwareRenderer(s);
-    SDL_SetRenderDrawColor(rnd, 0, 0, 0, 255);
-    SDL_RenderClear(rnd);
-
-    w.render(s, rnd);
-    r.render(s, rnd);
-    g.render(s, rnd);
-    b.render(s, rnd);
-
-    SDL_RenderPresent(rnd);
-    SDL_DestroyRenderer(rnd);
+  // layers from bottom to top
+  Path &layer(int i) {
+    switch(i) {
+      case 0: return w;
+      case 1: return r;
+      case 2: return g;
+      default: return b;
+    }
   }
 
-  void mutate(SDL_Surface *s, int stage) {
+  Change mutate(SDL_Surface *s, int stage) {
     int max;
 
     switch(stage) {
@@ -103,24 +92,29 @@ struct RGBW {
     }
 
     switch(rand() % max) {
-      case 0: for(int i = 0; i < 1; ++i) w.grow(s); break;
-      case 1: for(int i = 0; i < 1; ++i) w.mutate(s); break;
-      case 2: for(int i = 0; i < 1; ++i) r.grow(s); break;
-      case 3: for(int i = 0; i < 1; ++i) r.mutate(s); break;
-      case 4: for(int i = 0; i < 1; ++i) g.grow(s); break;
-      case 5: for(int i = 0; i < 1; ++i) g.mutate(s); break;
-      case 6: for(int i = 0; i < 1; ++i) b.grow(s); break;
-      case 7: for(int i = 0; i < 1; ++i) b.mutate(s); break;
+      case 0: return {0, w.grow(s)};
+      case 1: return {0, w.mutate(s)};
+      case 2: return {1, r.grow(s)};
+      case 3: return {1, r.mutate(s)};
+      case 4: return {2, g.grow(s)};
+      case 5: return {2, g.mutate(s)};
+      case 6: return {3, b.grow(s)};
+      case 7: return {3, b.mutate(s)};
     }
+
+    return {0, {0, 0, 0, {}}};
+  }
+
+  void undo(const Change &c) {
+    layer(c.layer).steps.undo(c.steps);
   }
 
   uint64_t stitchCount() {
     return r.steps.size() + g.steps.size() + b.steps.size() + w.steps.size();
   }
 
-  void initPath(Path &p, SDL_Surface *s) {
-    int distance = 5 * DEFAULT_STITCH;
-
+  // spiral of distance long steps around the centre
+  void initPath(Path &p, SDL_Surface *s, int distance) {
     float x = s->w / 2;
     float y = s->h / 2;
     int steps = 1;
@@ -148,22 +142,22 @@ struct RGBW {
     }
   }
 
-  void initPaths(SDL_Surface *s) {
-    initPath(w, s);
-    initPath(r, s);
-    initPath(g, s);
-    initPath(b, s);
+  void initPaths(SDL_Surface *s, int distance) {
+    initPath(w, s, distance);
+    initPath(r, s, distance);
+    initPath(g, s, distance);
+    initPath(b, s, distance);
   }
 
-  void savePaths(ostream &o) {
-    o << "White" << endl;
-    for(Path::Step &s: w.steps) o << s.x << " " << s.y << endl;
-    o << "Red" << endl;
-    for(Path::Step &s: r.steps) o << s.x << " " << s.y << endl;
-    o << "Green" << endl;
-    for(Path::Step &s: g.steps) o << s.x << " " << s.y << endl;
-    o << "Blue" << endl;
-    for(Path::Step &s: b.steps) o << s.x << " " << s.y << endl;
+  void scale(int factor) {
+    w.steps.scale(factor);
+    r.steps.scale(factor);
+    g.steps.scale(factor);
+    b.steps.scale(factor);
+  }
+
+  void save(const char *filename, int factor) const {
+    saveLayers(filename, w, r, g, b, factor);
   }
 };
 
@@ -171,33 +165,6 @@ uint32_t &pixel(SDL_Surface *s, int x, int y) {
   return *reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(s->pixels) + s->pitch * y + 4 * x);
 }
 
-int64_t rate(SDL_Surface *reference, SDL_Surface *rendered) {
-  int64_t value = 0;
-
-  SDL_LockSurface(rendered);
-  SDL_LockSurface(reference);
-
-  for(int y = 1; y < reference->h - 1; ++y) {
-    for(int x = 1; x < reference->w - 1; ++x) {
-      int r1 = (pixel(reference, x, y) & 0xff);
-      int r2 = (pixel(rendered, x, y) & 0xff);
-      int g1 = (pixel(reference, x, y) & 0xff00) >> 8;
-      int g2 = (pixel(rendered, x, y) & 0xff00) >> 8;
-      int b1 = (pixel(reference, x, y) & 0xff0000) >> 16;
-      int b2 = (pixel(rendered, x, y) & 0xff0000) >> 16;
-
-      value -= (r1 - r2) * (r1 - r2) +
-               (g1 - g2) * (g1 - g2) +
-               (b1 - b2) * (b1 - b2);
-    }
-  }
-
-  SDL_UnlockSurface(reference);
-  SDL_UnlockSurface(rendered);
-
-  return value;
-}
-
 Path generateRandomPath(SDL_Surface *s, int r, int g, int b) {
   Path ret;
   ret.r = r;
@@ -230,38 +197,17 @@ uint64_t time() {
   return tv.tv_sec * 1000000ull + tv.tv_usec;
 }
 
-SDL_Surface *simulateRGBView(SDL_Surface *src) {
-  SDL_Surface *ret = SDL_CreateRGBSurface(0, src->w / SCALE, src->h / SCALE, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
-
-  SDL_LockSurface(ret);
-
-  for(int y = 0; y < ret->h; ++y) {
-    for(int x = 0; x < ret->w; ++x) {
-      int r = 0, g = 0, b = 0;
-
-      for(int yy = 0; yy < SCALE; ++yy) {
-        for(int xx = 0; xx < SCALE; ++xx) {
-          r += pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff;
-          g += (pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff00) >> 8;
-          b += (pixel(src, x * SCALE + xx, y * SCALE + yy) & 0xff0000) >> 16;
-        }
-      }
-
-      pixel(ret, x, y) =
-        r / (SCALE * SCALE) + 
-        g / (SCALE * SCALE) * 0x100 + 
-        b / (SCALE * SCALE) * 0x10000 +
-        0xff000000ull;
-    }
-  }
-
-  SDL_UnlockSurface(ret);
-  return ret;
+void simulateRGBView(SDL_Surface *src, PlanarImage &dst) {
+  StageTimers::Scope timer(stageTimers(), STAGE_DOWNSAMPLE);
+  IntegralImage integral;
+  integral.build(src);
+  downsampleBlock(integral, SCALE, dst);
 }
 
 int main(int argc, const char *const argv[]) {
-  if(argc != 5) {
-    cerr << "usage: ./path-guessing <scale reduction (try 3)> <default stitch size (try 10)> <input image> <output.p>" << endl;
+  if(argc < 5 || argc > 7) {
+    cerr << "usage: ./path-guessing <scale reduction (try 3)> <default stitch size (try 10)> <input image> <output.p or output.vp3> "
+      "[coarse levels (default: 0)] [seconds per coarse level (try 30)]" << endl;
     return 1;
   }
 
@@ -271,11 +217,22 @@ int main(int argc, const char *const argv[]) {
   istringstream default_stitch(argv[2]);
   default_stitch >> DEFAULT_STITCH;
 
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-    cerr << "Could not init SDL: " << SDL_GetError() << endl;
-    return 1;
+  int levels = 0;
+  if(argc > 5) {
+    istringstream levels_arg(argv[5]);
+    levels_arg >> levels;
+  }
+
+  int levelSeconds = 30;
+  if(argc > 6) {
+    istringstream seconds_arg(argv[6]);
+    seconds_arg >> levelSeconds;
   }
 
+  if(batch().seeded) srand(batch().seed);
+
+  if(!Display::init()) return 1;
+
   const int allFormats = IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF;
   if(!IMG_Init(allFormats)) {
     cerr << "Could not init SDL_Image" << endl;
@@ -295,67 +252,87 @@ int main(int argc, const char *const argv[]) {
   }
   SDL_BlitSurface(rawImg, 0, img, 0);
 
-  SDL_Surface *zoomedImg = simulateRGBView(img);
-
-  SDL_Window *const win = SDL_CreateWindow("path-guessing", 0, 0, img->w / SCALE, img->h / SCALE, 0);
-  if(!win) {
-    cerr << "Could not open window" << endl;
-    return 1;
-  }
-
-  SDL_Surface *const screen = SDL_GetWindowSurface(win);
-  if(!screen) {
-    cerr << "Could not get screen surface" << endl;
-    return 1;
-  }
+  Pyramid pyramid(img, SCALE, levels, levelSeconds, LEVEL_PATIENCE);
 
-  SDL_Surface *const tmp = SDL_CreateRGBSurface(0, img->w, img->h, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+  Display display;
+  if(!display.open("path-guessing", img->w / SCALE, img->h / SCALE)) return 1;
 
   RGBW rgbw;
-  rgbw.initPaths(tmp);
-
-  int64_t quality = -9999999999ll;
+  rgbw.initPaths(pyramid.image(), pyramid.shrink(5 * DEFAULT_STITCH));
 
-  SDL_Event event;
   bool running = true;
   uint64_t last = time();
 
   int stage = 0;
+  int64_t quality = 0;
 
   while(running) {
-    while(SDL_PollEvent(&event)) {
-      switch(event.type) {
-        case SDL_QUIT: running = false;
-      }
-    }
+    SDL_Surface *const levelImg = pyramid.image();
 
-    RGBW n = rgbw;
-    n.mutate(tmp, stage);
-    ++stage;
-    n.render(tmp);
-    SDL_Surface *zoomed = simulateRGBView(tmp);
-    int64_t quality2 = rate(zoomedImg, zoomed) - rgbw.stitchCount() * STITCH_COST;
+    PlanarImage zoomedImg;
+    simulateRGBView(levelImg, zoomedImg);
 
-    if(quality2 > quality) {
-      rgbw = n;
-      quality = quality2;
+    SDL_Surface *const zoomed = SDL_CreateRGBSurface(0, zoomedImg.w, zoomedImg.h, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+
+    IncrementalRating rating(zoomedImg, levelImg->w, levelImg->h, SCALE, IncrementalRating::BLOCK, 1);
+    {
+      StageTimers::Scope timer(stageTimers(), STAGE_RENDER);
+      rating.addLayers(rgbw);
     }
 
-    if(time() > last + 1000000ull) {
-      cout << quality << " / " << quality2 << " / " << stage << " / " << rgbw.stitchCount() << endl;
+    quality = -9999999999ll;
+
+    while(running && !pyramid.converged()) {
+      if(display.closed() || batch().exhausted(stage)) running = false;
 
-      // SDL_BlitSurface(zoomedImg, 0, screen, 0);
-      SDL_BlitSurface(zoomed, 0, screen, 0);
-      SDL_UpdateWindowSurface(win);
+      const uint64_t stitches = rgbw.stitchCount();
+      const RGBW::Change change = rgbw.mutate(levelImg, stage);
+      ++stage;
+      int64_t quality2;
+      {
+        StageTimers::Scope timer(stageTimers(), STAGE_RATE);
+        rating.replaceSteps(change.layer, rgbw.layer(change.layer),
+            change.steps.first, change.steps.old, change.steps.removed, change.steps.added);
+        quality2 = rating.quality() - stitches * STITCH_COST;
+      }
+
+      pyramid.update(quality2 > quality);
+      stageTimers().count(COUNT_CANDIDATES);
+
+      if(quality2 > quality) {
+        stageTimers().count(COUNT_ACCEPTED);
+        quality = quality2;
+        rating.accept();
+      } else {
+        rating.reject();
+        rgbw.undo(change);
+      }
 
-      ofstream vp3(argv[4]);
-      rgbw.savePaths(vp3);
+      if(time() > last + 1000000ull) {
+        cout << quality << " / " << quality2 << " / " << stage << " / " << rgbw.stitchCount() << endl;
 
-      last = time();
+        // SDL_BlitSurface(zoomedImg, 0, screen, 0);
+        rating.toSurface(zoomed);
+        display.show(zoomed);
+
+        rgbw.save(argv[4], pyramid.factor());
+
+        last = time();
+      }
     }
-    
+
     SDL_FreeSurface(zoomed);
+
+    if(running) {
+      pyramid.descend();
+      rgbw.scale(2);
+      stageTimers().count(COUNT_LEVELS);
+      cout << "level 1/" << pyramid.factor() << endl;
+    }
   }
 
+  rgbw.save(argv[4], pyramid.factor());
+  batch().writeStats("path-guessing", argv[3], rgbw.stitchCount(), true, quality);
+
   atexit(SDL_Quit);
 }
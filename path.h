@@ -0,0 +1,382 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Step sequence of the path tools.
+//
+// Steps are kept in chunks of a few hundred, each with the sum of its steps, and a Fenwick
+// tree over the chunk sums. Finding step i, offsetting it, inserting or erasing a step and
+// the absolute position after any number of steps all cost O(log n) plus at most one
+// chunk's worth of copying, instead of moving the whole tail or summing up from the start.
+// Chunks are split when they get too large and merged into a neighbour when they get too
+// small, and there never are empty ones.
+struct Steps {
+  struct Step {
+    int x, y;
+  };
+
+  struct Sum {
+    size_t count;
+    int x, y;
+
+    void add(const Sum &s) { count += s.count; x += s.x; y += s.y; }
+  };
+
+  struct Chunk {
+    std::vector<Step> steps;
+    Sum sum;
+  };
+
+  // chunks are filled up to CHUNK steps and split at 2 * CHUNK
+  static const size_t CHUNK = 256;
+
+  std::vector<Chunk> chunks;
+  std::vector<Sum> tree;
+  size_t total;
+
+  Steps(): tree(1, Sum{0, 0, 0}), total(0) { }
+
+  struct const_iterator {
+    const Steps *s;
+    size_t chunk, offset;
+
+    const Step &operator*() const { return s->chunks[chunk].steps[offset]; }
+    const Step *operator->() const { return &**this; }
+
+    const_iterator &operator++() {
+      if(++offset == s->chunks[chunk].steps.size()) {
+        ++chunk;
+        offset = 0;
+      }
+      return *this;
+    }
+
+    bool operator==(const const_iterator &o) const { return chunk == o.chunk && offset == o.offset; }
+    bool operator!=(const const_iterator &o) const { return !(*this == o); }
+  };
+
+  const_iterator begin() const { return const_iterator{this, 0, 0}; }
+  const_iterator end() const { return const_iterator{this, chunks.size(), 0}; }
+
+  size_t size() const { return total; }
+  bool empty() const { return !total; }
+
+  void clear() {
+    chunks.clear();
+    total = 0;
+    rebuild();
+  }
+
+  void rebuild() {
+    const size_t n = chunks.size();
+    tree.assign(n + 1, Sum{0, 0, 0});
+
+    for(size_t i = 1; i <= n; ++i) {
+      tree[i].add(chunks[i - 1].sum);
+
+      const size_t parent = i + (i & -i);
+      if(parent <= n) tree[parent].add(tree[i]);
+    }
+  }
+
+  void update(size_t chunk, const Sum &delta) {
+    chunks[chunk].sum.add(delta);
+
+    for(size_t i = chunk + 1; i < tree.size(); i += i & -i) tree[i].add(delta);
+  }
+
+  // chunk holding step i, the offset within it and the sum of the chunks before it
+  void locate(size_t i, size_t &chunk, size_t &offset, Sum &before) const {
+    const size_t n = chunks.size();
+    size_t pos = 0;
+    size_t bit = 1;
+
+    before = Sum{0, 0, 0};
+    while(bit * 2 <= n) bit *= 2;
+
+    for(; bit; bit /= 2) {
+      if(pos + bit <= n && before.count + tree[pos + bit].count <= i) {
+        pos += bit;
+        before.add(tree[pos]);
+      }
+    }
+
+    chunk = pos;
+    offset = i - before.count;
+  }
+
+  const Step &operator[](size_t i) const {
+    size_t chunk, offset;
+    Sum before;
+    locate(i, chunk, offset, before);
+
+    return chunks[chunk].steps[offset];
+  }
+
+  // where the path is after its first i steps, relative to its start
+  Step position(size_t i) const {
+    size_t chunk, offset;
+    Sum before;
+    locate(std::min(i, total), chunk, offset, before);
+
+    Step p = {before.x, before.y};
+    for(size_t j = 0; j < offset; ++j) {
+      p.x += chunks[chunk].steps[j].x;
+      p.y += chunks[chunk].steps[j].y;
+    }
+
+    return p;
+  }
+
+  void offset(size_t i, int dx, int dy) {
+    if(i >= total) return;
+
+    size_t chunk, offset;
+    Sum before;
+    locate(i, chunk, offset, before);
+
+    chunks[chunk].steps[offset].x += dx;
+    chunks[chunk].steps[offset].y += dy;
+    update(chunk, Sum{0, dx, dy});
+  }
+
+  void scale(int factor) {
+    for(Chunk &c: chunks) {
+      for(Step &s: c.steps) {
+        s.x *= factor;
+        s.y *= factor;
+      }
+
+      c.sum.x *= factor;
+      c.sum.y *= factor;
+    }
+
+    rebuild();
+  }
+
+  void push_back(const Step &s) {
+    if(chunks.empty() || chunks.back().steps.size() >= CHUNK) {
+      chunks.push_back(Chunk{std::vector<Step>(), Sum{0, 0, 0}});
+      chunks.back().steps.reserve(CHUNK);
+      rebuild();
+    }
+
+    chunks.back().steps.push_back(s);
+    update(chunks.size() - 1, Sum{1, s.x, s.y});
+    ++total;
+  }
+
+  // inserts s before step i
+  void insert(size_t i, const Step &s) {
+    if(i >= total) {
+      push_back(s);
+      return;
+    }
+
+    size_t chunk, offset;
+    Sum before;
+    locate(i, chunk, offset, before);
+
+    std::vector<Step> &steps = chunks[chunk].steps;
+    steps.insert(steps.begin() + offset, s);
+    update(chunk, Sum{1, s.x, s.y});
+    ++total;
+
+    if(steps.size() >= 2 * CHUNK) split(chunk);
+  }
+
+  void erase(size_t i) {
+    if(i >= total) return;
+
+    size_t chunk, offset;
+    Sum before;
+    locate(i, chunk, offset, before);
+
+    std::vector<Step> &steps = chunks[chunk].steps;
+    const Step s = steps[offset];
+    steps.erase(steps.begin() + offset);
+    update(chunk, Sum{static_cast<size_t>(-1), -s.x, -s.y});
+    --total;
+
+    if(steps.size() < CHUNK / 4) merge(chunk);
+  }
+
+  // steps [first, first + removed) were replaced by steps [first, first + added), old keeps
+  // the replaced ones for rating the change and for undo()
+  struct Change {
+    size_t first, removed, added;
+    Step old[2];
+  };
+
+  // The edits the path-guessing tools make their candidates with. They change the steps in
+  // place, a candidate that is no better is taken back with undo().
+
+  // moves the end of step i by (dx, dy), the rest of the path stays where it is
+  Change moveVertex(size_t i, int dx, int dy) {
+    const Change c = {i, 2, 2, {(*this)[i], (*this)[i + 1]}};
+    offset(i, dx, dy);
+    offset(i + 1, -dx, -dy);
+
+    return c;
+  }
+
+  // adds a vertex (dx, dy) from the start of step i, the rest of the path stays where it is
+  Change insertVertex(size_t i, int dx, int dy) {
+    // an empty path only gains the new step
+    const Change c = empty()? Change{0, 0, 1, {}}: Change{i, 1, 2, {(*this)[i]}};
+    insert(i, {dx, dy});
+    offset(i + 1, -dx, -dy);
+
+    return c;
+  }
+
+  // joins steps i and i + 1
+  Change removeVertex(size_t i) {
+    const Step s = (*this)[i];
+    const Change c = {i, 2, 1, {s, (*this)[i + 1]}};
+    offset(i + 1, s.x, s.y);
+    erase(i);
+
+    return c;
+  }
+
+  // takes back c, which has to be the last change
+  void undo(const Change &c) {
+    for(size_t i = 0; i < c.added; ++i) erase(c.first);
+    for(size_t i = 0; i < c.removed; ++i) insert(c.first + i, c.old[i]);
+  }
+
+  // drops all steps from i on
+  void truncate(size_t i) {
+    if(i >= total) return;
+
+    size_t chunk, offset;
+    Sum before;
+    locate(i, chunk, offset, before);
+
+    chunks.resize(chunk + 1);
+    chunks[chunk].steps.resize(offset);
+    if(!offset) chunks.pop_back();
+    else chunks[chunk].sum = sumOf(chunks[chunk].steps);
+
+    total = i;
+    rebuild();
+  }
+
+  static Sum sumOf(const std::vector<Step> &steps) {
+    Sum s = {steps.size(), 0, 0};
+
+    for(size_t i = 0; i < steps.size(); ++i) {
+      s.x += steps[i].x;
+      s.y += steps[i].y;
+    }
+
+    return s;
+  }
+
+  void split(size_t chunk) {
+    std::vector<Step> &steps = chunks[chunk].steps;
+    Chunk second = { std::vector<Step>(steps.begin() + steps.size() / 2, steps.end()), Sum{0, 0, 0} };
+
+    steps.resize(steps.size() / 2);
+    chunks[chunk].sum = sumOf(steps);
+    second.sum = sumOf(second.steps);
+    chunks.insert(chunks.begin() + chunk + 1, second);
+
+    rebuild();
+  }
+
+  void merge(size_t chunk) {
+    if(chunks[chunk].steps.empty()) {
+      chunks.erase(chunks.begin() + chunk);
+      rebuild();
+      return;
+    }
+
+    if(chunks.size() < 2) return;
+
+    // always merge the later chunk into the earlier one
+    const size_t first = chunk + 1 < chunks.size()? chunk: chunk - 1;
+    std::vector<Step> &steps = chunks[first].steps;
+    const std::vector<Step> &next = chunks[first + 1].steps;
+
+    steps.insert(steps.end(), next.begin(), next.end());
+    chunks[first].sum = sumOf(steps);
+    chunks.erase(chunks.begin() + first + 1);
+
+    if(steps.size() >= 2 * CHUNK) split(first);
+    else rebuild();
+  }
+};
+
+// The vertices of a path (its position after each step, relative to its start) bucketed by a
+// grid of distance x distance cells, hashed into a table of about one bucket per vertex, for
+// finding all vertices close to a point without comparing against every one of them.
+struct VertexGrid {
+  int distance;
+  size_t tableSize;
+  std::vector<Steps::Step> vertices;
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> entries;
+
+  VertexGrid(const Steps &steps, int d): distance(d), tableSize(1) {
+    vertices.reserve(steps.size());
+
+    Steps::Step p = {0, 0};
+    for(const Steps::Step &s: steps) {
+      p.x += s.x;
+      p.y += s.y;
+      vertices.push_back(p);
+    }
+
+    while(tableSize < vertices.size()) tableSize *= 2;
+    starts.assign(tableSize + 1, 0);
+    entries.resize(vertices.size());
+
+    // counting sort into the buckets, keeping the vertices of each bucket in path order
+    for(size_t i = 0; i < vertices.size(); ++i) ++starts[bucket(cell(vertices[i].x), cell(vertices[i].y)) + 1];
+    for(size_t b = 0; b < tableSize; ++b) starts[b + 1] += starts[b];
+
+    std::vector<uint32_t> fill(starts.begin(), starts.end() - 1);
+    for(size_t i = 0; i < vertices.size(); ++i) entries[fill[bucket(cell(vertices[i].x), cell(vertices[i].y))]++] = i;
+  }
+
+  int cell(int v) const {
+    return v >= 0? v / distance: -((-v + distance - 1) / distance);
+  }
+
+  size_t bucket(int cx, int cy) const {
+    return (static_cast<uint32_t>(cx) * 73856093u ^ static_cast<uint32_t>(cy) * 19349663u) & (tableSize - 1);
+  }
+
+  // indices of the vertices v with |v.x - x| < distance and |v.y - y| < distance, ascending
+  void near(int x, int y, std::vector<size_t> &found) const {
+    size_t buckets[9];
+    size_t n = 0;
+
+    for(int cy = cell(y) - 1; cy <= cell(y) + 1; ++cy) {
+      for(int cx = cell(x) - 1; cx <= cell(x) + 1; ++cx) buckets[n++] = bucket(cx, cy);
+    }
+
+    // different cells may share a bucket
+    std::sort(buckets, buckets + n);
+    n = std::unique(buckets, buckets + n) - buckets;
+
+    found.clear();
+
+    for(size_t i = 0; i < n; ++i) {
+      for(uint32_t e = starts[buckets[i]]; e < starts[buckets[i] + 1]; ++e) {
+        const Steps::Step &v = vertices[entries[e]];
+        if(abs(v.x - x) < distance && abs(v.y - y) < distance) found.push_back(entries[e]);
+      }
+    }
+
+    std::sort(found.begin(), found.end());
+  }
+};
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef PLANAR_IMAGE_H
+#define PLANAR_IMAGE_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLANAR_IMAGE_X86
+#endif
+
+// Image core shared by the path tools.
+//
+// Surfaces store 0xAABBGGRR words, which every loop has to unpack with masks and shifts.
+// Here images are kept as one 8 bit plane per channel, so rating two images is a plain
+// sum of squared differences over byte rows (done with SSE2 or AVX2 where available), and
+// downsampling goes through a summed-area table, so the cost per output pixel does not
+// depend on the window size. All kernels are exact integer arithmetic: the vectorized and
+// the scalar variants give identical results.
+
+struct PlanarImage {
+  int w, h;
+  std::vector<uint8_t> planes[3];
+
+  PlanarImage(): w(0), h(0) { }
+  PlanarImage(int width, int height) { resize(width, height); }
+
+  void resize(int width, int height) {
+    w = width;
+    h = height;
+
+    for(int c = 0; c < 3; ++c) planes[c].assign(w * h, 0);
+  }
+
+  uint8_t *row(int c, int y) { return &planes[c][y * w]; }
+  const uint8_t *row(int c, int y) const { return &planes[c][y * w]; }
+
+  void fromSurface(SDL_Surface *s) {
+    resize(s->w, s->h);
+
+    SDL_LockSurface(s);
+
+    for(int y = 0; y < h; ++y) {
+      const uint32_t *src = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(s->pixels) + s->pitch * y);
+      uint8_t *r = row(0, y);
+      uint8_t *g = row(1, y);
+      uint8_t *b = row(2, y);
+
+      for(int x = 0; x < w; ++x) {
+        r[x] = src[x] & 0xff;
+        g[x] = (src[x] & 0xff00) >> 8;
+        b[x] = (src[x] & 0xff0000) >> 16;
+      }
+    }
+
+    SDL_UnlockSurface(s);
+  }
+
+  void toSurface(SDL_Surface *s) const {
+    SDL_LockSurface(s);
+
+    for(int y = 0; y < h && y < s->h; ++y) {
+      uint32_t *dst = reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(s->pixels) + s->pitch * y);
+      const uint8_t *r = row(0, y);
+      const uint8_t *g = row(1, y);
+      const uint8_t *b = row(2, y);
+
+      for(int x = 0; x < w && x < s->w; ++x) {
+        dst[x] = r[x] + g[x] * 0x100 + b[x] * 0x10000 + 0xff000000u;
+      }
+    }
+
+    SDL_UnlockSurface(s);
+  }
+};
+
+// Summed-area table per channel, (w + 1) x (h + 1) with a zero first row and column. Sums are
+// kept modulo 2^32, so box sums stay exact as long as a single box does not exceed that.
+struct IntegralImage {
+  int w, h;
+  std::vector<uint32_t> planes[3];
+
+  IntegralImage(): w(0), h(0) { }
+
+  void build(SDL_Surface *s) {
+    w = s->w;
+    h = s->h;
+
+    for(int c = 0; c < 3; ++c) planes[c].assign((w + 1) * (h + 1), 0);
+
+    SDL_LockSurface(s);
+
+    for(int y = 0; y < h; ++y) {
+      const uint32_t *src = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(s->pixels) + s->pitch * y);
+      const uint32_t *above[3];
+      uint32_t *out[3];
+
+      for(int c = 0; c < 3; ++c) {
+        above[c] = &planes[c][y * (w + 1) + 1];
+        out[c] = &planes[c][(y + 1) * (w + 1) + 1];
+      }
+
+      uint32_t r = 0, g = 0, b = 0;
+
+      for(int x = 0; x < w; ++x) {
+        r += src[x] & 0xff;
+        g += (src[x] & 0xff00) >> 8;
+        b += (src[x] & 0xff0000) >> 16;
+
+        out[0][x] = above[0][x] + r;
+        out[1][x] = above[1][x] + g;
+        out[2][x] = above[2][x] + b;
+      }
+    }
+
+    SDL_UnlockSurface(s);
+  }
+
+  // sum of channel c over [x0, x1) x [y0, y1)
+  uint32_t sum(int c, int x0, int y0, int x1, int y1) const {
+    const uint32_t *p = &planes[c][0];
+    const int stride = w + 1;
+
+    return p[y1 * stride + x1] - p[y0 * stride + x1] - p[y1 * stride + x0] + p[y0 * stride + x0];
+  }
+};
+
+// simulateRGBView of path-guessing, path-guessing2 and path-evolving: average of the
+// SCALE x SCALE block at (x * SCALE, y * SCALE)
+inline void downsampleBlock(const IntegralImage &src, int scale, PlanarImage &dst) {
+  dst.resize(src.w / scale, src.h / scale);
+
+  const uint32_t count = scale * scale;
+
+  for(int c = 0; c < 3; ++c) {
+    for(int y = 0; y < dst.h; ++y) {
+      uint8_t *out = dst.row(c, y);
+
+      for(int x = 0; x < dst.w; ++x) {
+        out[x] = src.sum(c, x * scale, y * scale, (x + 1) * scale, (y + 1) * scale) / count;
+      }
+    }
+  }
+}
+
+// simulateRGBView<SCALE> of path-guessing3: average of the (2 * SCALE + 1)^2 window around
+// (x * SCALE, y * SCALE), leaving the outermost SCALE pixels black
+inline void downsampleCentered(const IntegralImage &src, int scale, PlanarImage &dst) {
+  dst.resize(src.w / scale, src.h / scale);
+
+  const uint32_t count = (2 * scale + 1) * (2 * scale + 1);
+
+  for(int c = 0; c < 3; ++c) {
+    for(int y = scale; y < dst.h - scale; ++y) {
+      uint8_t *out = dst.row(c, y);
+
+      for(int x = scale; x < dst.w - scale; ++x) {
+        out[x] = src.sum(c, x * scale - scale, y * scale - scale, x * scale + scale + 1, y * scale + scale + 1) / count;
+      }
+    }
+  }
+}
+
+inline int64_t squaredDifferencesScalar(const uint8_t *a, const uint8_t *b, int n) {
+  int64_t sum = 0;
+
+  for(int i = 0; i < n; ++i) {
+    const int d = a[i] - b[i];
+    sum += d * d;
+  }
+
+  return sum;
+}
+
+#ifdef PLANAR_IMAGE_X86
+// 32 bit lanes grow by at most 4 * 255^2 per iteration, flush them long before they overflow
+#define PLANAR_IMAGE_FLUSH 4096
+
+__attribute__((target("sse2")))
+inline int64_t squaredDifferencesSSE2(const uint8_t *a, const uint8_t *b, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  int64_t sum = 0;
+  int i = 0;
+
+  while(i + 16 <= n) {
+    __m128i acc = zero;
+
+    for(int j = 0; j < PLANAR_IMAGE_FLUSH && i + 16 <= n; ++j, i += 16) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    sum += static_cast<int64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  return sum + squaredDifferencesScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline int64_t squaredDifferencesAVX2(const uint8_t *a, const uint8_t *b, int n) {
+  const __m256i zero = _mm256_setzero_si256();
+  int64_t sum = 0;
+  int i = 0;
+
+  while(i + 32 <= n) {
+    __m256i acc = zero;
+
+    for(int j = 0; j < PLANAR_IMAGE_FLUSH && i + 32 <= n; ++j, i += 32) {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      const __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+      const __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(lo, lo));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(hi, hi));
+    }
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+    for(int l = 0; l < 8; ++l) sum += lanes[l];
+  }
+
+  return sum + squaredDifferencesSSE2(a + i, b + i, n - i);
+}
+#endif
+
+typedef int64_t (*SquaredDifferences)(const uint8_t *, const uint8_t *, int);
+
+// picked once at runtime, EMBROIDERY_KERNELS=scalar|sse2|avx2 overrides the detection
+inline SquaredDifferences detectSquaredDifferences() {
+  const char *forced = getenv("EMBROIDERY_KERNELS");
+
+  if(forced && !strcmp(forced, "scalar")) return squaredDifferencesScalar;
+
+#ifdef PLANAR_IMAGE_X86
+  if(forced && !strcmp(forced, "sse2")) return squaredDifferencesSSE2;
+  if(__builtin_cpu_supports("avx2")) return squaredDifferencesAVX2;
+  if(__builtin_cpu_supports("sse2")) return squaredDifferencesSSE2;
+#endif
+
+  return squaredDifferencesScalar;
+}
+
+inline SquaredDifferences &squaredDifferences() {
+  static SquaredDifferences kernel = detectSquaredDifferences();
+  return kernel;
+}
+
+// sum over all channels of (a - b)^2 in [x0, x1) x [y0, y1)
+inline int64_t sumSquaredDifferences(const PlanarImage &a, const PlanarImage &b, int x0, int y0, int x1, int y1) {
+  const SquaredDifferences kernel = squaredDifferences();
+  int64_t sum = 0;
+
+  if(x1 <= x0) return 0;
+
+  for(int c = 0; c < 3; ++c) {
+    for(int y = y0; y < y1; ++y) {
+      sum += kernel(a.row(c, y) + x0, b.row(c, y) + x0, x1 - x0);
+    }
+  }
+
+  return sum;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "planar-image.h"
+
+// Coarse-to-fine schedule for the path tools.
+//
+// While the paths are still crude, rating them against the full resolution image mostly
+// finds out where the colours go, which a much smaller image tells just as well. With
+// levels > 0 the paths are optimized against the image shrunk by 2^levels first, where a
+// candidate costs about 4^levels times less. A level ends when its time budget is used up
+// or patience updates in a row brought no improvement; then every step is doubled and the
+// next finer level carries on with them. Paths are always in the coordinates of the current
+// level. Full resolution has no budget and runs until the window is closed, as before.
+struct Pyramid {
+  // the downsampled view of the coarsest level keeps at least this many pixels per side
+  static const int MIN_SIZE = 16;
+
+  SDL_Surface *original;
+  SDL_Surface *surface;
+  int level;
+  uint64_t budget, patience;
+  uint64_t started, idle;
+
+  Pyramid(SDL_Surface *img, int scale, int levels, int seconds, uint64_t p):
+      original(img), surface(img), level(0), budget(seconds * 1000000ull), patience(p), started(0), idle(0) {
+    while(level < levels &&
+        (img->w >> (level + 1)) / scale >= MIN_SIZE &&
+        (img->h >> (level + 1)) / scale >= MIN_SIZE) {
+      ++level;
+    }
+
+    enter();
+  }
+
+  ~Pyramid() {
+    if(surface != original) SDL_FreeSurface(surface);
+  }
+
+  // image of the current level
+  SDL_Surface *image() const { return surface; }
+
+  // size of a unit of the current level at full resolution
+  int factor() const { return 1 << level; }
+
+  // a full resolution length in units of the current level
+  int shrink(int length) const { return std::max(1, length >> level); }
+
+  void enter() {
+    if(surface != original) SDL_FreeSurface(surface);
+    surface = original;
+
+    if(level) {
+      IntegralImage integral;
+      PlanarImage shrunk;
+
+      integral.build(original);
+      downsampleBlock(integral, factor(), shrunk);
+
+      surface = SDL_CreateRGBSurface(0, shrunk.w, shrunk.h, 32, 0xff, 0xff00, 0xff0000, 0xff000000u);
+      shrunk.toSurface(surface);
+    }
+
+    started = now();
+    idle = 0;
+  }
+
+  void update(bool improved) {
+    idle = improved? 0: idle + 1;
+  }
+
+  bool converged() const {
+    return level && (idle >= patience || now() > started + budget);
+  }
+
+  // the caller doubles the steps of its paths
+  void descend() {
+    --level;
+    enter();
+  }
+
+  static uint64_t now() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+
+    return tv.tv_sec * 1000000ull + tv.tv_usec;
+  }
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// Region bookkeeping for the path-filling tools.
+//
+// A pixel is to be filled while its red channel is set. Instead of scanning the whole image
+// for the nearest such pixel and clearing a mark in every pixel before each flood fill, this
+// labels the 8-connected regions once (area, top-left pixel and bounding box each) and keeps
+// the number of remaining pixels per 16 x 16 cell, so the nearest one is found by searching
+// outwards from the current position.
+//
+// Pixels are only ever removed (stitched or dropped). A region that lost pixels may have
+// been split, so it is marked dirty and the part that is actually asked about gets labelled
+// again on demand. All flood fills use an explicit stack.
+struct FillRegions {
+  struct Region {
+    int area;
+    int seedX, seedY; // topmost, then leftmost pixel
+    int x0, y0, x1, y1;
+    bool dirty;
+  };
+
+  static const int CELL = 16;
+
+  int w, h;
+  int cellsW, cellsH;
+  int remaining;
+
+  std::vector<uint8_t> fill;
+  std::vector<uint32_t> labels;
+  std::vector<Region> regions;
+  std::vector<int> counts;
+  std::vector<uint32_t> visited;
+  uint32_t generation;
+  std::vector<int> stack;
+
+  explicit FillRegions(SDL_Surface *s):
+      w(s->w), h(s->h), cellsW((s->w + CELL - 1) / CELL), cellsH((s->h + CELL - 1) / CELL), remaining(0),
+      fill(w * h), labels(w * h), regions(1), counts(cellsW * cellsH), visited(w * h), generation(0) {
+    SDL_LockSurface(s);
+
+    for(int y = 0; y < h; ++y) {
+      const uint32_t *src = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(s->pixels) + s->pitch * y);
+
+      for(int x = 0; x < w; ++x) {
+        if(!(src[x] & 0xff)) continue;
+
+        fill[y * w + x] = 1;
+        ++counts[(y / CELL) * cellsW + x / CELL];
+        ++remaining;
+      }
+    }
+
+    SDL_UnlockSurface(s);
+
+    // scanning in row order, the first pixel of each region is its top-left one
+    for(int i = 0; i < w * h; ++i) {
+      if(fill[i] && !labels[i]) label(i, 0);
+    }
+  }
+
+  bool isFill(int x, int y) const {
+    return x >= 0 && y >= 0 && x < w && y < h && fill[y * w + x];
+  }
+
+  // moves the pixels reachable from seed that still carry label from into a new region
+  uint32_t label(int seed, uint32_t from) {
+    const uint32_t to = regions.size();
+    Region r = { 0, seed % w, seed / w, seed % w, seed / w, seed % w, seed / w, false };
+
+    labels[seed] = to;
+    stack.push_back(seed);
+
+    while(!stack.empty()) {
+      const int i = stack.back();
+      const int x = i % w;
+      const int y = i / w;
+      stack.pop_back();
+
+      ++r.area;
+      if(y < r.seedY || (y == r.seedY && x < r.seedX)) {
+        r.seedX = x;
+        r.seedY = y;
+      }
+      if(x < r.x0) r.x0 = x;
+      if(y < r.y0) r.y0 = y;
+      if(x > r.x1) r.x1 = x;
+      if(y > r.y1) r.y1 = y;
+
+      for(int dy = -1; dy < 2; ++dy) {
+        for(int dx = -1; dx < 2; ++dx) {
+          if(!isFill(x + dx, y + dy)) continue;
+
+          const int n = (y + dy) * w + x + dx;
+          if(labels[n] != from) continue;
+
+          labels[n] = to;
+          stack.push_back(n);
+        }
+      }
+    }
+
+    regions.push_back(r);
+    if(from) regions[from].area -= r.area;
+
+    return to;
+  }
+
+  void remove(int x, int y) {
+    if(!isFill(x, y)) return;
+
+    const int i = y * w + x;
+    Region &r = regions[labels[i]];
+
+    fill[i] = 0;
+    --counts[(y / CELL) * cellsW + x / CELL];
+    --remaining;
+    --r.area;
+    r.dirty = true;
+  }
+
+  // nearest remaining pixel, ties going to the first one in row order
+  bool nearest(int x, int y, int &bestX, int &bestY) const {
+    if(!remaining) return false;
+
+    const int qx = x < 0? 0: x >= w? cellsW - 1: x / CELL;
+    const int qy = y < 0? 0: y >= h? cellsH - 1: y / CELL;
+    const int maxRing = std::max(std::max(qx, cellsW - 1 - qx), std::max(qy, cellsH - 1 - qy));
+    int64_t bestDist = -1;
+
+    auto scan = [&](int cx, int cy) {
+      if(cx < 0 || cy < 0 || cx >= cellsW || cy >= cellsH || !counts[cy * cellsW + cx]) return;
+
+      const int x0 = cx * CELL;
+      const int y0 = cy * CELL;
+      const int x1 = std::min(x0 + CELL, w);
+      const int y1 = std::min(y0 + CELL, h);
+
+      const int64_t ex = x < x0? x0 - x: x >= x1? x - x1 + 1: 0;
+      const int64_t ey = y < y0? y0 - y: y >= y1? y - y1 + 1: 0;
+      if(bestDist >= 0 && ex * ex + ey * ey > bestDist) return;
+
+      for(int py = y0; py < y1; ++py) {
+        for(int px = x0; px < x1; ++px) {
+          if(!fill[py * w + px]) continue;
+
+          const int64_t dist = int64_t(x - px) * (x - px) + int64_t(y - py) * (y - py);
+          if(bestDist < 0 || dist < bestDist || (dist == bestDist && (py < bestY || (py == bestY && px < bestX)))) {
+            bestX = px;
+            bestY = py;
+            bestDist = dist;
+          }
+        }
+      }
+    };
+
+    for(int ring = 0; ring <= maxRing; ++ring) {
+      if(bestDist >= 0 && ring > 0) {
+        const int64_t bound = int64_t(ring - 1) * CELL + 1;
+        if(bound * bound > bestDist) break;
+      }
+
+      if(!ring) {
+        scan(qx, qy);
+        continue;
+      }
+
+      for(int cx = qx - ring; cx <= qx + ring; ++cx) {
+        scan(cx, qy - ring);
+        scan(cx, qy + ring);
+      }
+
+      for(int cy = qy - ring + 1; cy < qy + ring; ++cy) {
+        scan(qx - ring, cy);
+        scan(qx + ring, cy);
+      }
+    }
+
+    return bestDist >= 0;
+  }
+
+  // whether the region around (x, y) still has at least area pixels
+  bool hasAreaAbove(int x, int y, int area) {
+    const Region &r = regions[labels[y * w + x]];
+    if(!r.dirty) return r.area >= area;
+
+    // only count as far as needed
+    int found = 0;
+
+    ++generation;
+    visited[y * w + x] = generation;
+    stack.push_back(y * w + x);
+
+    while(!stack.empty() && found < area) {
+      const int i = stack.back();
+      const int sx = i % w;
+      const int sy = i / w;
+      stack.pop_back();
+      ++found;
+
+      for(int dy = -1; dy < 2; ++dy) {
+        for(int dx = -1; dx < 2; ++dx) {
+          if(!isFill(sx + dx, sy + dy)) continue;
+
+          const int n = (sy + dy) * w + sx + dx;
+          if(visited[n] == generation) continue;
+
+          visited[n] = generation;
+          stack.push_back(n);
+        }
+      }
+    }
+
+    stack.clear();
+
+    return found >= area;
+  }
+
+  // topmost, then leftmost pixel of the region around (x, y)
+  void moveToTopLeft(int &x, int &y) {
+    uint32_t l = labels[y * w + x];
+    if(regions[l].dirty) l = label(y * w + x, l);
+
+    x = regions[l].seedX;
+    y = regions[l].seedY;
+  }
+};
+
+#endif
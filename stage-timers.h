@@ -0,0 +1,124 @@
+#ifndef STAGE_TIMERS_H
+#define STAGE_TIMERS_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <stdint.h>
+
+// Wall-clock time and calls per stage of the path tools, plus a few counters, written as one
+// JSON object (see path-batch.c++ and path-bench.c++). Timing is off unless enabled, then a
+// Scope costs two clock reads. Everything is atomic, the islands of path-evolving share it.
+enum Stage {
+  STAGE_RENDER,     // drawing paths (StitchRaster, IncrementalRating::addPath)
+  STAGE_DOWNSAMPLE, // simulateRGBView and StitchRaster::downsample
+  STAGE_RATE,       // comparing against the reference, incrementally or not
+  STAGE_EDGE,       // edge field and stitch direction rating (path-guessing3)
+  STAGE_CROSSOVER,  // cross() of path-evolving
+  STAGES
+};
+
+enum Counter {
+  COUNT_CANDIDATES,  // rated candidates (individuals for path-evolving)
+  COUNT_ACCEPTED,    // candidates that replaced the current paths (an island's best for path-evolving)
+  COUNT_GENERATIONS, // path-evolving
+  COUNT_LEVELS,      // coarse-to-fine levels finished
+  COUNTERS
+};
+
+struct StageTimers {
+  bool enabled;
+  std::atomic<uint64_t> calls[STAGES];
+  std::atomic<uint64_t> nanoseconds[STAGES];
+  std::atomic<uint64_t> counters[COUNTERS];
+
+  StageTimers(): enabled(false) {
+    reset();
+  }
+
+  void reset() {
+    for(int i = 0; i < STAGES; ++i) {
+      calls[i] = 0;
+      nanoseconds[i] = 0;
+    }
+    for(int i = 0; i < COUNTERS; ++i) counters[i] = 0;
+  }
+
+  void count(Counter c, uint64_t n = 1) {
+    counters[c] += n;
+  }
+
+  // times the stage from construction to destruction
+  struct Scope {
+    StageTimers &timers;
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+
+    Scope(StageTimers &t, Stage s): timers(t), stage(s) {
+      if(timers.enabled) start = std::chrono::steady_clock::now();
+    }
+
+    ~Scope() {
+      if(!timers.enabled) return;
+
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+      timers.calls[stage] += 1;
+      timers.nanoseconds[stage] += ns.count();
+    }
+  };
+
+  static const char *stageName(int s) {
+    static const char *const NAMES[STAGES] = { "render", "downsample", "rate", "edge", "crossover" };
+    return NAMES[s];
+  }
+
+  static const char *counterName(int c) {
+    static const char *const NAMES[COUNTERS] = { "candidates", "accepted", "generations", "levels" };
+    return NAMES[c];
+  }
+
+  // "stages": {...}, "counters": {...} without the enclosing braces, so callers can add fields
+  void writeFields(std::ostream &o) const {
+    o << "\"stages\": {";
+    for(int i = 0; i < STAGES; ++i) {
+      // average is seconds per call
+      o << (i? ", ": "") << "\"" << stageName(i) << "\": {\"calls\": " << calls[i] <<
+        ", \"seconds\": " << nanoseconds[i] / 1e9 << ", \"average\": " << (calls[i]? nanoseconds[i] / 1e9 / calls[i]: 0) << "}";
+    }
+
+    o << "}, \"counters\": {";
+    for(int i = 0; i < COUNTERS; ++i) {
+      o << (i? ", ": "") << "\"" << counterName(i) << "\": " << counters[i];
+    }
+    o << "}";
+  }
+};
+
+inline StageTimers &stageTimers() {
+  static StageTimers timers;
+  return timers;
+}
+
+// JSON string literal of s
+inline std::string jsonString(const std::string &s) {
+  std::string out = "\"";
+
+  for(char c: s) {
+    if(c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if(static_cast<unsigned char>(c) < 0x20) {
+      static const char *const HEX = "0123456789abcdef";
+      out += "\\u00";
+      out += HEX[c >> 4];
+      out += HEX[c & 0xf];
+    } else {
+      out += c;
+    }
+  }
+
+  return out + "\"";
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef STITCH_RASTER_H
+#define STITCH_RASTER_H
+
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "planar-image.h"
+
+// Walks the pixels of a stitch from (x0, y0) to (x1, y1), both end points included, the same
+// way SDL's software renderer draws lines.
+template<class Plot> inline void walkLine(int x0, int y0, int x1, int y1, Plot plot) {
+  const int dx = abs(x1 - x0);
+  const int dy = -abs(y1 - y0);
+  const int sx = x0 < x1? 1: -1;
+  const int sy = y0 < y1? 1: -1;
+  int err = dx + dy;
+
+  while(1) {
+    plot(x0, y0);
+    if(x0 == x1 && y0 == y1) break;
+
+    const int e2 = 2 * err;
+    if(e2 >= dy) { err += dy; x0 += sx; }
+    if(e2 <= dx) { err += dx; y0 += sy; }
+  }
+}
+
+// Renders paths straight into the downsampled view.
+//
+// The full resolution image is only ever needed to average it down again, so instead of
+// drawing into a full resolution surface this keeps one SCALE x SCALE cell per downsampled
+// pixel: a bit mask of the pixels already drawn and the colour sums over them. A cell is the
+// SCALE x SCALE block the simulateRGBView of path-evolving averages (path-bench measures it
+// too). Paths have to be added topmost first, every pixel keeps the first colour drawn to it.
+// Nothing is allocated after construction.
+struct StitchRaster {
+  int w, h;
+  int cellsW, cellsH;
+  int scale;
+
+  std::vector<uint64_t> drawn;
+  std::vector<uint16_t> sums;
+  std::vector<int> cellX, cellY;
+  std::vector<uint64_t> bitX, bitY;
+
+  StitchRaster(int width, int height, int s):
+      w(width), h(height), cellsW(width / s), cellsH(height / s), scale(s),
+      drawn(cellsW * cellsH), sums(cellsW * cellsH * 3), cellX(cellsW * s), cellY(cellsH * s), bitX(cellsW * s), bitY(cellsH * s) {
+    if(scale * scale > 64) throw "scale too large";
+
+    for(int x = 0; x < cellsW * scale; ++x) {
+      cellX[x] = x / scale;
+      bitX[x] = 1ull << (x % scale);
+    }
+
+    for(int y = 0; y < cellsH * scale; ++y) {
+      cellY[y] = y / scale;
+      bitY[y] = 1ull << (y % scale * scale);
+    }
+  }
+
+  void clear() {
+    memset(&drawn[0], 0, drawn.size() * sizeof(drawn[0]));
+    memset(&sums[0], 0, sums.size() * sizeof(sums[0]));
+  }
+
+  void plot(int x, int y, unsigned int r, unsigned int g, unsigned int b) {
+    if(x < 0 || y < 0 || x >= cellsW * scale || y >= cellsH * scale) return;
+
+    const int cell = cellY[y] * cellsW + cellX[x];
+    const uint64_t bit = bitX[x] * bitY[y];
+
+    if(drawn[cell] & bit) return;
+    drawn[cell] |= bit;
+
+    uint16_t *s = &sums[cell * 3];
+    s[0] += r; s[1] += g; s[2] += b;
+  }
+
+  template<class Path> void addPath(const Path &p) {
+    int x = w / 2;
+    int y = h / 2;
+
+    for(const auto &s: p.steps) {
+      walkLine(x, y, x + s.x, y + s.y, [&](int px, int py) { plot(px, py, p.r, p.g, p.b); });
+      x += s.x;
+      y += s.y;
+    }
+  }
+
+  // the view simulateRGBView would have produced from the full resolution rendering
+  void downsample(PlanarImage &dst) const {
+    dst.resize(cellsW, cellsH);
+
+    const int count = scale * scale;
+
+    for(int i = 0; i < cellsW * cellsH; ++i) {
+      for(int c = 0; c < 3; ++c) dst.planes[c][i] = sums[i * 3 + c] / count;
+    }
+  }
+};
+
+#endif
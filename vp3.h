@@ -0,0 +1,341 @@
+#ifndef VP3_H
+#define VP3_H
+
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Streaming .vp3 writer and reader.
+//
+// The writer produces the same bytes p-stitch.ey does (see vp3view.ey and
+// http://www.jasonweiler.com/VP3FileFormatInfo.html for the layout), but stitches go straight
+// to the stream. Lengths and extents are only known at the end, so placeholders are written
+// for them and patched by finish(), which needs a seekable stream (i.e. a file).
+//
+// Coordinates are in 100 μm units.
+
+// 300 μm per pixel, the value suggested for p-stitch
+#define VP3_DEFAULT_SCALE 3
+
+inline bool isVP3File(const std::string &name) {
+  return name.size() >= 4 && name.compare(name.size() - 4, 4, ".vp3") == 0;
+}
+
+struct VP3Writer {
+  struct Color {
+    std::streampos length, lengthStart;
+    std::streampos start;
+    std::streampos stitchLength, stitchStart;
+  };
+
+  std::ostream &out;
+  int x, y;
+  int minX, maxX, minY, maxY;
+  std::streampos mainLength, mainStart, mainExtents, mainColors;
+  std::streampos innerLength, innerStart, innerExtents, innerColors;
+  std::vector<Color> colors;
+
+  explicit VP3Writer(std::ostream &o): out(o), x(0), y(0), minX(0), maxX(0), minY(0), maxY(0) {
+    bytes("%vsm%\0", 6);
+    string(std::string("Stratum 0 Embroidery Hack\0", 26));
+    bytes("\0\2\0", 3);
+    mainLength = placeholder(4);
+    mainStart = out.tellp();
+
+    string("File comments go here (or don't)");
+    mainExtents = placeholder(16);
+    bytes("\0\0\172\206", 4); // TODO thread length (ahem)
+    bytes("\0", 1);
+    mainColors = placeholder(1);
+    bytes("\14\0\1\0\3\0", 6);
+    innerLength = placeholder(4);
+    innerStart = out.tellp();
+
+    u32(0); // origin X
+    u32(0); // origin Y
+    bytes("\0\0\0", 3);
+    innerExtents = placeholder(24);
+    string("Yet another comment");
+    u16(25700);
+    u32(4096);
+    u32(0);
+    u32(0);
+    u32(4096);
+    bytes("xxPP\0", 5); // stitch section header
+    string("Yet another vendor string");
+    innerColors = placeholder(2);
+  }
+
+  void bytes(const char *b, size_t n) { out.write(b, n); }
+  void u8(uint32_t v) { out.put(static_cast<char>(v & 0xff)); }
+  void u16(uint32_t v) { u8(v >> 8); u8(v); }
+  void u32(uint32_t v) { u16(v >> 16); u16(v); }
+  void string(const std::string &s) { u16(s.size()); bytes(s.data(), s.size()); }
+
+  std::streampos placeholder(int n) {
+    const std::streampos pos = out.tellp();
+    for(int i = 0; i < n; ++i) u8(0);
+    return pos;
+  }
+
+  template<class Write> void patch(std::streampos pos, Write write) {
+    const std::streampos end = out.tellp();
+    out.seekp(pos);
+    write();
+    out.seekp(end);
+  }
+
+  void beginColor(const std::string &name, unsigned int r, unsigned int g, unsigned int b) {
+    Color c;
+
+    if(!colors.empty()) u8(0);
+    bytes("\0\5\0", 3);
+    c.length = placeholder(4);
+    c.lengthStart = out.tellp();
+    c.start = placeholder(8);
+    bytes("\1\0", 2);
+    u8(r);
+    u8(g);
+    u8(b);
+    bytes("\0\0\0\5\50", 5);
+    string("1234");
+    string(name);
+    string("Thread type");
+    u32(0); // start x offset for next color
+    u32(0); // start y offset for next color
+    string(std::string("\0", 1));
+    c.stitchLength = placeholder(4);
+    c.stitchStart = out.tellp();
+    bytes("\12\366\0", 3);
+
+    colors.push_back(c);
+    x = 0;
+    y = 0;
+  }
+
+  void stitch(int dx, int dy) {
+    if(dx > -128 && dx < 128 && dy > -128 && dy < 128) {
+      u8(dx);
+      u8(dy);
+    } else {
+      bytes("\200\1", 2);
+      u16(dx);
+      u16(dy);
+      bytes("\200\2", 2);
+    }
+
+    x += dx;
+    y += dy;
+    if(x < minX) minX = x;
+    if(y < minY) minY = y;
+    if(x > maxX) maxX = x;
+    if(y > maxY) maxY = y;
+  }
+
+  void endColor() {
+    const Color &c = colors.back();
+    const std::streampos end = out.tellp();
+
+    patch(c.length, [&]() { u32(end - c.lengthStart + 1); });
+    patch(c.stitchLength, [&]() { u32(end - c.stitchStart); });
+  }
+
+  // steps are multiplied by scale, i.e. scale is the size of a path unit in 100 μm
+  template<class Path> void addPath(const std::string &name, const Path &p, int scale) {
+    beginColor(name, p.r, p.g, p.b);
+    for(const auto &s: p.steps) stitch(s.x * scale, s.y * scale);
+    endColor();
+  }
+
+  void finish() {
+    const std::streampos end = out.tellp();
+    const int xSize = maxX - minX;
+    const int ySize = maxY - minY;
+
+    for(size_t i = 0; i < colors.size(); ++i) {
+      patch(colors[i].start, [&]() {
+        u32((-minX - xSize / 2) * 100);
+        u32(-(-minY - ySize / 2) * 100);
+      });
+    }
+
+    patch(mainLength, [&]() { u32(end - mainStart); });
+    patch(mainExtents, [&]() {
+      u32(xSize * 100 / 2);
+      u32(ySize * 100 / 2);
+      u32(-(xSize * 100 / 2));
+      u32(-(ySize * 100 / 2));
+    });
+    patch(mainColors, [&]() { u8(colors.size()); });
+    patch(innerLength, [&]() { u32(end - innerStart); });
+    patch(innerExtents, [&]() {
+      u32(xSize * 100 / 2);
+      u32(ySize * 100 / 2);
+      u32(-(xSize * 100 / 2));
+      u32(-(ySize * 100 / 2));
+      u32(xSize * 100);
+      u32(ySize * 100);
+    });
+    patch(innerColors, [&]() { u16(colors.size()); });
+
+    out.flush();
+  }
+};
+
+// The output of the RGBW path tools: a .vp3 gets the stitches directly, anything else the .p
+// text format, both in the order white, red, green, blue. Steps are multiplied by factor, the
+// size of a path unit in pixels of the input image.
+template<class Path> inline void saveLayers(const std::string &filename, const Path &w, const Path &r, const Path &g, const Path &b, int factor) {
+  const Path *const layers[4] = { &w, &r, &g, &b };
+  const char *const names[4] = { "White", "Red", "Green", "Blue" };
+
+  if(isVP3File(filename)) {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    VP3Writer vp3(out);
+    for(int i = 0; i < 4; ++i) vp3.addPath(names[i], *layers[i], VP3_DEFAULT_SCALE * factor);
+    vp3.finish();
+  } else {
+    std::ofstream out(filename.c_str());
+    for(int i = 0; i < 4; ++i) {
+      out << names[i] << std::endl;
+      for(const auto &s: layers[i]->steps) out << s.x * factor << " " << s.y * factor << std::endl;
+    }
+  }
+}
+
+// Reads the files the writer produces (and the ones vp3view.ey understands), one colour and
+// one stitch at a time. Throws a message on malformed input.
+struct VP3Reader {
+  struct Color {
+    unsigned int r, g, b;
+    std::string name;
+    int startX, startY; // in μm
+    uint32_t stitchBytes;
+  };
+
+  std::istream &in;
+  int positiveX, positiveY, negativeX, negativeY; // in μm
+  int width, height; // in μm
+  std::string comment, vendor;
+  int colors;
+
+  int colorsRead;
+  uint32_t stitchBytes, stitchPos;
+
+  explicit VP3Reader(std::istream &i): in(i), colorsRead(0), stitchBytes(0), stitchPos(0) {
+    if(bytes(6) != std::string("%vsm%\0", 6)) throw "not a valid vp3 file";
+    vendor = string();
+    bytes(3);
+    u32(); // remaining file size
+    comment = string();
+
+    positiveX = s32();
+    positiveY = s32();
+    negativeX = s32();
+    negativeY = s32();
+    bytes(4); // thread length
+    bytes(1);
+    u8(); // number of colors, repeated below
+    bytes(6);
+    u32(); // remaining file size
+
+    s32(); // origin X
+    s32(); // origin Y
+    bytes(3);
+    for(int i = 0; i < 4; ++i) s32(); // centered extents
+    width = s32();
+    height = s32();
+    string();
+
+    u16();
+    for(int i = 0; i < 4; ++i) u32();
+
+    // p-stitch.ey writes "xxPP\0", machine generated files "xxPP\1\0"
+    if(bytes(4) != "xxPP") throw "could not find stitch section header";
+    if(u8() == 1) u8();
+    string();
+
+    colors = u16();
+  }
+
+  std::string bytes(size_t n) {
+    std::string s(n, '\0');
+    if(n && !in.read(&s[0], n)) throw "unexpected end of file";
+    return s;
+  }
+
+  uint32_t u8() {
+    const int c = in.get();
+    if(c == EOF) throw "unexpected end of file";
+    return c;
+  }
+
+  uint32_t u16() { const uint32_t hi = u8(); return hi << 8 | u8(); }
+  uint32_t u32() { const uint32_t hi = u16(); return hi << 16 | u16(); }
+  int s16() { return static_cast<int16_t>(u16()); }
+  int s32() { return static_cast<int32_t>(u32()); }
+  std::string string() { return bytes(u16()); }
+
+  bool nextColor(Color &c) {
+    // skip whatever is left of the previous one
+    while(stitchPos < stitchBytes) {
+      u8();
+      ++stitchPos;
+    }
+
+    if(colorsRead == colors) return false;
+
+    if(colorsRead++) u8();
+    bytes(3);
+    u32(); // offset to next section
+    c.startX = s32();
+    c.startY = s32();
+    const uint32_t tableSize = u8();
+    u8();
+    c.r = u8();
+    c.g = u8();
+    c.b = u8();
+    bytes(tableSize * 5);
+    string();
+    c.name = string();
+    string(); // thread type
+    s32(); // offset for next color
+    s32();
+    string();
+    c.stitchBytes = stitchBytes = u32();
+
+    bytes(3);
+    stitchPos = 3;
+
+    return true;
+  }
+
+  // next stitch of the current colour, false at its end
+  bool nextStitch(int &dx, int &dy) {
+    while(stitchPos < stitchBytes) {
+      dx = static_cast<int8_t>(u8());
+      dy = static_cast<int8_t>(u8());
+      stitchPos += 2;
+
+      if(dx != -128) return true;
+
+      if(dy == 1) {
+        dx = s16();
+        dy = s16();
+        u16();
+        stitchPos += 6;
+        return true;
+      }
+
+      // markers, no movement
+      if(dy != 0 && dy != 3) throw "unknown special stitch";
+    }
+
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iomanip>
+
+#include "vp3.h"
+
+using namespace std;
+
+// Counterpart of vp3view.ey: dumps the header of a .vp3 and draws its stitches into an .svg.
+// With an output.p it writes the stitches back as .p instead (divided by the μm per unit
+// given), so p-stitch output can be checked against its input.
+
+int idiv(int a, int b) {
+  return a < 0? -(-a / b): a / b;
+}
+
+int main(int argc, char **argv) {
+  if(argc != 3 && argc != 4) {
+    cerr << "usage: ./vp3view <file.vp3> <output.svg or output.p> [μm per unit for .p (try 300)]" << endl;
+    return 1;
+  }
+
+  int scale = 1;
+  if(argc == 4) {
+    istringstream scaleStr(argv[3]);
+    if(!(scaleStr >> scale) || scale < 100) {
+      cerr << "μm per unit has to be at least 100" << endl;
+      return 1;
+    }
+    scale /= 100;
+  }
+
+  const string output = argv[2];
+  const bool svg = output.size() < 2 || output.compare(output.size() - 2, 2, ".p") != 0;
+
+  ifstream vp3(argv[1], ios::binary);
+  if(!vp3) {
+    cerr << "Could not open " << argv[1] << endl;
+    return 1;
+  }
+
+  ofstream out(argv[2]);
+
+  if(svg) {
+    out << "<?xml version=\"1.0\" standalone=\"no\" ?>\n";
+    out << "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n";
+    out << "<svg width=\"100%\" height=\"100%\" version=\"1.0\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+  }
+
+  try {
+    VP3Reader reader(vp3);
+
+    cout << reader.vendor.c_str() << endl;
+    cout << reader.comment << endl;
+    cout << "Positive X Image μm: " << reader.positiveX << endl;
+    cout << "Positive Y Image μm: " << reader.positiveY << endl;
+    cout << "Negative X Image μm: " << reader.negativeX << endl;
+    cout << "Negative Y Image μm: " << reader.negativeY << endl;
+    cout << "Image width μm: " << reader.width << endl;
+    cout << "Image height μm: " << reader.height << endl;
+    cout << "Number of colors: " << reader.colors << endl;
+
+    VP3Reader::Color c;
+    while(reader.nextColor(c)) {
+      cout << "=== Color ===" << endl;
+      cout << c.name << ": " << c.r << " " << c.g << " " << c.b << endl;
+      cout << "Start X Offset in μm: " << c.startX << endl;
+      cout << "Start Y Offset in μm: " << c.startY << endl;
+      cout << "Stitch bytes: " << c.stitchBytes << endl;
+
+      int x = -reader.negativeX / 100 + idiv(c.startX, 100);
+      int y = -reader.negativeY / 100 - idiv(c.startY, 100);
+      int stitches = 0;
+      int dx, dy;
+
+      if(!svg) out << c.name << endl;
+
+      while(reader.nextStitch(dx, dy)) {
+        if(svg) {
+          out << "<line x1=\"" << x << "\" y1=\"" << y << "\" x2=\"" << x + dx << "\" y2=\"" << y + dy << "\" stroke=\"#"
+              << hex << uppercase << setfill('0') << setw(2) << c.r << setw(2) << c.g << setw(2) << c.b << dec << "\" />\n";
+        } else {
+          out << dx / scale << " " << dy / scale << endl;
+        }
+
+        x += dx;
+        y += dy;
+        ++stitches;
+      }
+
+      cout << "Stitches: " << stitches << endl;
+      cout << "X: " << x << endl;
+      cout << "Y: " << y << endl;
+    }
+  } catch(const char *err) {
+    cerr << err << endl;
+    return 1;
+  }
+
+  if(svg) out << "</svg>\n";
+}